@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "liteproto/traits/traits.hpp"
+
+namespace liteproto {
+
+namespace internal {
+
+// A container takes an arena if it allocates through std::pmr::polymorphic_allocator, e.g., std::pmr::string,
+// std::pmr::vector, std::pmr::deque and std::pmr::map.
+template <class Tp>
+inline constexpr bool IsArenaContainerV = std::uses_allocator_v<std::remove_cv_t<Tp>, std::pmr::polymorphic_allocator<std::byte>>;
+
+template <class Tp, class = void>
+struct ArenaElementType {
+  using type = void;
+};
+
+template <class Tp>
+struct ArenaElementType<Tp, std::enable_if_t<!IsStringV<Tp> && IsListV<Tp>>> {
+  using type = typename ListTraits<Tp>::value_type;
+};
+
+template <class Tp>
+struct ArenaElementType<Tp, std::enable_if_t<IsMapV<Tp>>> {
+  using type = typename MapTraits<Tp>::mapped_type;
+};
+
+// Whether a value of Tp holds any message or arena container, which BindArena() has to visit.
+template <class Tp>
+constexpr bool NeedsArena() noexcept {
+  using type = std::remove_cv_t<Tp>;
+  using element_type = typename ArenaElementType<type>::type;
+  if constexpr (std::is_void_v<type>) {
+    return false;
+  } else if constexpr (IsMessageV<type> || IsArenaContainerV<type>) {
+    return true;
+  } else if constexpr (!std::is_void_v<element_type>) {
+    return NeedsArena<element_type>();
+  } else {
+    return false;
+  }
+}
+
+// Whether a value of Tp holds any message, whose fields are not bound by the allocator of the container.
+template <class Tp>
+constexpr bool HasMessage() noexcept {
+  using type = std::remove_cv_t<Tp>;
+  using element_type = typename ArenaElementType<type>::type;
+  if constexpr (IsMessageV<type>) {
+    return true;
+  } else if constexpr (!std::is_void_v<element_type>) {
+    return HasMessage<element_type>();
+  } else {
+    return false;
+  }
+}
+
+// Move all the arena containers inside the value onto the resource, including the fields of the messages and the
+// elements of the containers. A container which is already on the resource is kept as is, so it's cheap to bind a
+// freshly constructed value. Do nothing if the resource is nullptr.
+// A std::pmr container constructs its elements with its own allocator, but a message is not allocator-aware, so every
+// message which is created by a decoder inside an arena container has to be bound explicitly.
+template <class Tp>
+void BindArena(Tp& value, std::pmr::memory_resource* resource) {
+  using type = std::remove_cv_t<Tp>;
+  if constexpr (NeedsArena<type>()) {
+    if (resource == nullptr) {
+      return;
+    }
+    if constexpr (IsMessageV<type>) {
+      value.ForEachField([resource](auto, auto, auto& field) { BindArena(field, resource); });
+    } else {
+      if constexpr (IsArenaContainerV<type>) {
+        if (value.get_allocator().resource() != resource) {
+          // The allocator of a std::pmr container never propagates, so the container is rebuilt by the allocator
+          // extended move constructor, which moves the elements onto the resource.
+          type rebound(std::move(value), typename type::allocator_type(resource));
+          std::destroy_at(&value);
+          ::new (static_cast<void*>(&value)) type(std::move(rebound));
+        }
+      }
+      // The elements of an arena container are constructed on its resource, unless they hold messages.
+      using element_type = typename ArenaElementType<type>::type;
+      if constexpr (NeedsArena<element_type>() && (!IsArenaContainerV<type> || HasMessage<element_type>())) {
+        if constexpr (IsMapV<type>) {
+          for (auto& entry : value) {
+            BindArena(entry.second, resource);
+          }
+        } else {
+          for (auto& element : value) {
+            BindArena(element, resource);
+          }
+        }
+      }
+    }
+  }
+}
+
+// The decoders bind the values they add to an arena container through ArenaTraits. The elements constructed in the
+// container are already on its resource, unless they hold messages.
+template <class Tp>
+struct ArenaTraits<Tp, std::enable_if_t<IsArenaContainerV<Tp>>> {
+  template <class Value>
+  static void Bind(const Tp& container, Value& value) {
+    BindArena(value, container.get_allocator().resource());
+  }
+
+  template <class Element>
+  static void BindElement(const Tp& container, Element& element) {
+    if constexpr (HasMessage<Element>()) {
+      BindArena(element, container.get_allocator().resource());
+    }
+  }
+};
+
+}  // namespace internal
+
+// Arena is a monotonic memory resource for the messages of a single request. The std::pmr containers in the messages
+// created by Create() allocate from the arena, and so do the elements which are added by the decoders. Nothing is
+// freed until the arena is destroyed or Reset(), when all the memory is released at once.
+// A message opts in by declaring its fields as std::pmr containers, e.g., std::pmr::string or std::pmr::vector. The
+// other fields work as usual. The destructors of the objects created by Create() are still called, in the reverse
+// order of the creation, since a message may hold the fields outside of the arena.
+// Arena is not thread-safe, and it must outlive all the objects created by it.
+class Arena {
+ public:
+  Arena() = default;
+  // The first block is allocated with the given size, rather than growing from a small one.
+  explicit Arena(size_t initial_size) : resource_(initial_size) {}
+  // The first block is the given buffer, which is not owned by the arena.
+  Arena(void* buffer, size_t size) : resource_(buffer, size) {}
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  ~Arena() { Reset(); }
+
+  [[nodiscard]] std::pmr::memory_resource* resource() noexcept { return &resource_; }
+
+  // Construct a Tp on the arena, of which all the std::pmr containers allocate from the arena as well.
+  template <class Tp, class... Args>
+  Tp* Create(Args&&... args) {
+    void* memory = resource_.allocate(sizeof(Tp), alignof(Tp));
+    Tp* object;
+    if constexpr (internal::IsArenaContainerV<Tp>) {
+      object = ::new (memory) Tp(std::forward<Args>(args)..., typename Tp::allocator_type(&resource_));
+    } else {
+      object = ::new (memory) Tp(std::forward<Args>(args)...);
+    }
+    internal::BindArena(*object, &resource_);
+    if constexpr (!std::is_trivially_destructible_v<Tp>) {
+      auto cleanup = static_cast<Cleanup*>(resource_.allocate(sizeof(Cleanup), alignof(Cleanup)));
+      cleanups_ = ::new (cleanup) Cleanup{object, &Destroy<Tp>, cleanups_};
+    }
+    return object;
+  }
+
+  // Destroy all the objects created by the arena, and release the memory. The initial buffer is reused.
+  void Reset() noexcept {
+    for (Cleanup* cleanup = cleanups_; cleanup != nullptr; cleanup = cleanup->next) {
+      cleanup->destroy(cleanup->object);
+    }
+    cleanups_ = nullptr;
+    resource_.release();
+  }
+
+ private:
+  struct Cleanup {
+    void* object;
+    void (*destroy)(void*) noexcept;
+    Cleanup* next;
+  };
+
+  template <class Tp>
+  static void Destroy(void* object) noexcept {
+    std::destroy_at(static_cast<Tp*>(object));
+  }
+
+  std::pmr::monotonic_buffer_resource resource_;
+  Cleanup* cleanups_ = nullptr;
+};
+
+}  // namespace liteproto
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "liteproto/list.hpp"
+#include "liteproto/message.hpp"
+#include "liteproto/reflect/type.hpp"
+#include "liteproto/traits/traits.hpp"
+
+namespace liteproto {
+
+namespace internal {
+
+// Whether the values of Tp are equal if and only if their bytes are equal, so they can be compared by memcmp and
+// hashed as bytes. float and double are compared bitwise as well, i.e., NaN equals NaN with the same bits, and 0.0
+// doesn't equal -0.0, which keeps Equals() consistent with Hash().
+template <class Tp>
+constexpr bool IsBitwiseComparable() noexcept {
+  using type = std::remove_cv_t<Tp>;
+  if constexpr (IsMessageV<type> || IsStringV<type> || std::is_same_v<type, std::string_view>) {
+    return false;
+  } else if constexpr (std::is_same_v<type, float> || std::is_same_v<type, double>) {
+    return true;
+  } else {
+    return TypeMeta<type>::Traits(traits::has_unique_object_representations);
+  }
+}
+
+// Whether each key appears at most once in the map, i.e., insert() returns a pair like std::map rather than an iterator
+// like std::multimap.
+template <class Tp>
+constexpr bool HasUniqueKeys() noexcept {
+  using insert_result = decltype(std::declval<Tp&>().insert(std::declval<typename MapTraits<Tp>::value_type>()));
+  return !std::is_same_v<insert_result, decltype(std::declval<Tp&>().begin())>;
+}
+
+inline constexpr uint64_t kHashMultiplier = 0x9e3779b97f4a7c15ULL;
+
+constexpr uint64_t HashMix(uint64_t h) noexcept {
+  h ^= h >> 32;
+  h *= 0xd6e8feb86659fd93ULL;
+  h ^= h >> 32;
+  h *= 0xd6e8feb86659fd93ULL;
+  h ^= h >> 32;
+  return h;
+}
+
+constexpr uint64_t HashCombine(uint64_t seed, uint64_t h) noexcept { return (seed ^ HashMix(h)) * kHashMultiplier; }
+
+// Hash the bytes 8 at a time.
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed) noexcept {
+  auto p = static_cast<const unsigned char*>(data);
+  uint64_t h = HashCombine(seed, size);
+  for (; size >= sizeof(uint64_t); p += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(uint64_t));
+    h = HashCombine(h, word);
+  }
+  if (size != 0) {
+    uint64_t word = 0;
+    std::memcpy(&word, p, size);
+    h = HashCombine(h, word);
+  }
+  return HashMix(h);
+}
+
+template <class Msg>
+bool MessageEquals(const Msg& lhs, const Msg& rhs);
+
+template <class Msg>
+uint64_t MessageHash(const Msg& msg);
+
+template <class Tp>
+bool ValueEquals(const Tp& lhs, const Tp& rhs) {
+  using type = std::remove_cv_t<Tp>;
+  if constexpr (IsMessageV<type>) {
+    return MessageEquals(lhs, rhs);
+  } else if constexpr (IsStringV<type> || std::is_same_v<type, std::string_view>) {
+    return lhs.size() == rhs.size() && (lhs.size() == 0 || std::memcmp(lhs.data(), rhs.data(), lhs.size() * sizeof(*lhs.data())) == 0);
+  } else if constexpr (IsBitwiseComparable<type>()) {
+    return std::memcmp(&lhs, &rhs, sizeof(type)) == 0;
+  } else if constexpr (IsMapV<type>) {
+    // The maps may be unordered, so the entries are looked up by the keys.
+    if (lhs.size() != rhs.size()) {
+      return false;
+    }
+    if constexpr (HasUniqueKeys<type>()) {
+      for (const auto& [key, value] : lhs) {
+        auto it = rhs.find(key);
+        if (it == rhs.end() || !ValueEquals(value, it->second)) {
+          return false;
+        }
+      }
+    } else {
+      // The entries of a key are adjacent, and they are compared as a multiset since their order may differ.
+      for (auto it = lhs.begin(); it != lhs.end();) {
+        auto [lhs_first, lhs_last] = lhs.equal_range(it->first);
+        auto [rhs_first, rhs_last] = rhs.equal_range(it->first);
+        if (!std::is_permutation(lhs_first, lhs_last, rhs_first, rhs_last,
+                                 [](const auto& l, const auto& r) { return ValueEquals(l.second, r.second); })) {
+          return false;
+        }
+        it = lhs_last;
+      }
+    }
+    return true;
+  } else if constexpr (IsListV<type>) {
+    using value_type = std::remove_cv_t<typename ListTraits<type>::value_type>;
+    if (lhs.size() != rhs.size()) {
+      return false;
+    }
+    if constexpr (IsContiguous<type>::value && IsBitwiseComparable<value_type>()) {
+      return lhs.size() == 0 || std::memcmp(lhs.data(), rhs.data(), lhs.size() * sizeof(value_type)) == 0;
+    } else {
+      auto rhs_it = rhs.begin();
+      for (const auto& element : lhs) {
+        if (!ValueEquals<value_type>(element, *rhs_it)) {
+          return false;
+        }
+        ++rhs_it;
+      }
+      return true;
+    }
+  } else if constexpr (IsPairV<type>) {
+    return ValueEquals(lhs.first, rhs.first) && ValueEquals(lhs.second, rhs.second);
+  } else {
+    return lhs == rhs;
+  }
+}
+
+template <class Tp>
+uint64_t ValueHash(const Tp& value) {
+  using type = std::remove_cv_t<Tp>;
+  if constexpr (IsMessageV<type>) {
+    return MessageHash(value);
+  } else if constexpr (IsStringV<type> || std::is_same_v<type, std::string_view>) {
+    return HashBytes(value.data(), value.size() * sizeof(*value.data()), 0);
+  } else if constexpr (IsBitwiseComparable<type>()) {
+    return HashBytes(&value, sizeof(type), 0);
+  } else if constexpr (IsMapV<type>) {
+    // The hashes of the entries are summed up, so that the hash doesn't depend on the order of the entries.
+    uint64_t h = 0;
+    for (const auto& [key, mapped] : value) {
+      h += HashMix(HashCombine(ValueHash(key), ValueHash(mapped)));
+    }
+    return HashCombine(h, value.size());
+  } else if constexpr (IsListV<type>) {
+    using value_type = std::remove_cv_t<typename ListTraits<type>::value_type>;
+    if constexpr (IsContiguous<type>::value && IsBitwiseComparable<value_type>()) {
+      return HashBytes(value.data(), value.size() * sizeof(value_type), 0);
+    } else {
+      uint64_t h = HashCombine(0, value.size());
+      for (const auto& element : value) {
+        h = HashCombine(h, ValueHash<value_type>(element));
+      }
+      return HashMix(h);
+    }
+  } else if constexpr (IsPairV<type>) {
+    return HashMix(HashCombine(ValueHash(value.first), ValueHash(value.second)));
+  } else {
+    return std::hash<type>{}(value);
+  }
+}
+
+// The adjacent bitwise comparable fields of a message, which are compared by a single memcmp and hashed as a single
+// range of bytes. Since both messages have the same layout, the runs are the same no matter what the values are.
+class BytesRun {
+ public:
+  // Return false if the field doesn't follow the run, then the run has to be flushed before it's restarted.
+  bool Extend(const void* lhs, size_t size) noexcept {
+    if (size_ != 0 && lhs_ + size_ == static_cast<const char*>(lhs)) {
+      size_ += size;
+      return true;
+    }
+    return false;
+  }
+
+  void Restart(const void* lhs, const void* rhs, size_t size) noexcept {
+    lhs_ = static_cast<const char*>(lhs);
+    rhs_ = static_cast<const char*>(rhs);
+    size_ = size;
+  }
+
+  [[nodiscard]] bool Equal() const noexcept { return size_ == 0 || std::memcmp(lhs_, rhs_, size_) == 0; }
+  [[nodiscard]] uint64_t Hash(uint64_t seed) const noexcept { return size_ == 0 ? seed : HashBytes(lhs_, size_, seed); }
+
+ private:
+  const char* lhs_ = nullptr;
+  const char* rhs_ = nullptr;
+  size_t size_ = 0;
+};
+
+template <class Tp>
+bool FieldEquals(const Tp& lhs, const Tp& rhs, BytesRun* run) {
+  if constexpr (IsBitwiseComparable<Tp>()) {
+    if (run->Extend(&lhs, sizeof(Tp))) {
+      return true;
+    }
+    if (!run->Equal()) {
+      return false;
+    }
+    run->Restart(&lhs, &rhs, sizeof(Tp));
+    return true;
+  } else {
+    return ValueEquals(lhs, rhs);
+  }
+}
+
+template <class Tp>
+void FieldHash(const Tp& value, BytesRun* run, uint64_t* h) {
+  if constexpr (IsBitwiseComparable<Tp>()) {
+    if (!run->Extend(&value, sizeof(Tp))) {
+      *h = run->Hash(*h);
+      run->Restart(&value, nullptr, sizeof(Tp));
+    }
+  } else {
+    *h = HashCombine(*h, ValueHash(value));
+  }
+}
+
+template <class Tuple, size_t... I>
+bool TupleEquals(const Tuple& lhs, const Tuple& rhs, std::index_sequence<I...>) {
+  BytesRun run;
+  return (true && ... && FieldEquals(std::get<I>(lhs), std::get<I>(rhs), &run)) && run.Equal();
+}
+
+template <class Tuple, size_t... I>
+uint64_t TupleHash(const Tuple& tuple, std::index_sequence<I...>) {
+  BytesRun run;
+  uint64_t h = 0;
+  (FieldHash(std::get<I>(tuple), &run, &h), ...);
+  return HashMix(run.Hash(h));
+}
+
+template <class Msg>
+bool MessageEquals(const Msg& lhs, const Msg& rhs) {
+  if (&lhs == &rhs) {
+    return true;
+  }
+  auto lhs_tuple = lhs.DumpTuple();
+  auto rhs_tuple = rhs.DumpTuple();
+  return TupleEquals(lhs_tuple, rhs_tuple, std::make_index_sequence<std::tuple_size_v<decltype(lhs_tuple)>>{});
+}
+
+template <class Msg>
+uint64_t MessageHash(const Msg& msg) {
+  auto tuple = msg.DumpTuple();
+  return TupleHash(tuple, std::make_index_sequence<std::tuple_size_v<decltype(tuple)>>{});
+}
+
+}  // namespace internal
+
+// Return whether all the fields of the messages are equal, the embedded messages and the containers are compared deeply.
+// The adjacent fields whose values are equal if and only if their bytes are equal (e.g., integers and enums) are
+// compared by a single memcmp, so are the contiguous lists of them. The entries of a map are compared regardless of the
+// order, as are the values of the same key in a multimap. The floating point fields are compared bitwise.
+template <class Msg, class = std::enable_if_t<IsMessageV<Msg>>>
+[[nodiscard]] bool Equals(const Msg& lhs, const Msg& rhs) {
+  return internal::MessageEquals(lhs, rhs);
+}
+
+// Return the hash of the content of the message, which is consistent with Equals(). The hash is not stable across
+// builds, since the adjacent fields are hashed as the bytes of the message.
+template <class Msg, class = std::enable_if_t<IsMessageV<Msg>>>
+[[nodiscard]] size_t Hash(const Msg& msg) {
+  return static_cast<size_t>(internal::MessageHash(msg));
+}
+
+// The function objects for the unordered containers keyed by the content of the messages.
+struct MessageHasher {
+  template <class Msg>
+  size_t operator()(const Msg& msg) const {
+    return Hash(msg);
+  }
+};
+
+struct MessageEqual {
+  template <class Msg>
+  bool operator()(const Msg& lhs, const Msg& rhs) const {
+    return Equals(lhs, rhs);
+  }
+};
+
+}  // namespace liteproto
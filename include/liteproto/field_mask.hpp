@@ -0,0 +1,148 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "liteproto/reflect/type.hpp"
+
+namespace liteproto {
+
+template <class Msg, int32_t Line>
+class MessageBase;
+
+// FieldMask selects a subset of the fields of a message type, so that the parsing skips the other fields at the wire
+// level, and the serialization only emits the selected fields. A path is a dotted list of fields, each of which is
+// either a field name or a seq number, e.g., "inner.name", "7.2" or "inner.2". A path of several fields can only go
+// through the embedded messages, while a path which ends at an embedded message selects the whole message.
+//
+// The mask is a bitset over the fields in the order of FieldsIndices, so testing a field is a single AND, and the child
+// masks are indexed by the fields as well. The mask is built for a specific message type, the masked parsing and
+// serialization of another type fail.
+class FieldMask {
+  template <class, int32_t>
+  friend class MessageBase;
+
+ public:
+  // Return std::nullopt if a path is unknown or goes through a field which is not a message.
+  template <class Msg>
+  static std::optional<FieldMask> FromPaths(const std::vector<std::string_view>& paths) {
+    FieldMask mask;
+    mask.Init<Msg>();
+    for (auto path : paths) {
+      if (!mask.AddPath<Msg>(path)) {
+        return std::nullopt;
+      }
+    }
+    return mask;
+  }
+
+  template <class Msg>
+  static std::optional<FieldMask> FromSeqs(const std::vector<int32_t>& seqs) {
+    FieldMask mask;
+    mask.Init<Msg>();
+    for (int32_t seq : seqs) {
+      int32_t index = seq > 0 ? Msg::FieldsParser::Find(seq) : -1;
+      if (index < 0) {
+        return std::nullopt;
+      }
+      mask.Set(index);
+    }
+    return mask;
+  }
+
+  // An empty mask (e.g., a default constructed one) selects no field.
+  [[nodiscard]] bool Test(int32_t index) const noexcept {
+    return static_cast<size_t>(index >> 6) < bits_.size() && ((bits_[index >> 6] >> (index & 63)) & 1);
+  }
+
+  // Return the mask of a selected embedded message, or nullptr if the message is selected as a whole.
+  [[nodiscard]] const FieldMask* Child(int32_t index) const noexcept {
+    if (static_cast<size_t>(index) >= child_slots_.size() || child_slots_[index] < 0) {
+      return nullptr;
+    }
+    return &children_[child_slots_[index]];
+  }
+
+  // Whether the mask is built for Msg. An empty mask (e.g., a default constructed one) is for any message.
+  template <class Msg>
+  [[nodiscard]] bool IsFor() const noexcept {
+    return type_ == nullptr || type_ == &internal::kTypeId<Msg>;
+  }
+
+ private:
+  template <class Msg>
+  void Init() {
+    if (bits_.empty()) {
+      bits_.resize((Msg::FieldsIndices::value.size() + 63) / 64);
+      type_ = &internal::kTypeId<Msg>;
+    }
+  }
+
+  void Set(int32_t index) noexcept { bits_[index >> 6] |= uint64_t{1} << (index & 63); }
+
+  template <class Msg>
+  static int32_t FindField(std::string_view name) noexcept {
+    int32_t seq = 0;
+    auto [end, ec] = std::from_chars(name.data(), name.data() + name.size(), seq);
+    if (ec == std::errc{} && end == name.data() + name.size()) {
+      return seq > 0 ? Msg::FieldsParser::Find(seq) : -1;
+    }
+    return Msg::FindFieldByName(name);
+  }
+
+  template <class Msg>
+  bool AddPath(std::string_view path) {
+    Init<Msg>();
+    auto dot = path.find('.');
+    int32_t index = FindField<Msg>(path.substr(0, dot));
+    if (index < 0) {
+      return false;
+    }
+    if (dot == std::string_view::npos) {
+      Set(index);
+      if (auto child = const_cast<FieldMask*>(Child(index)); child != nullptr) {
+        // The slot is dropped, the child itself is left in children_ so that the other slots still hold.
+        *child = FieldMask{};
+        child_slots_[index] = -1;
+      }
+      return true;
+    }
+    auto resolver = Msg::FieldsParser::mask_resolvers[index];
+    if (resolver == nullptr) {
+      return false;
+    }
+    auto child = const_cast<FieldMask*>(Child(index));
+    if (child == nullptr) {
+      if (Test(index)) {
+        // The whole message is selected, the path is only checked.
+        FieldMask unused;
+        return resolver(&unused, path.substr(dot + 1));
+      }
+      if (child_slots_.empty()) {
+        child_slots_.resize(Msg::FieldsIndices::value.size(), -1);
+      }
+      child_slots_[index] = static_cast<int32_t>(children_.size());
+      child = &children_.emplace_back();
+    }
+    Set(index);
+    return resolver(child, path.substr(dot + 1));
+  }
+
+  template <class Msg>
+  static bool AddChildPath(FieldMask* child, std::string_view path) {
+    return child->AddPath<Msg>(path);
+  }
+
+  std::vector<uint64_t> bits_;
+  std::vector<FieldMask> children_;
+  // The position in children_ of the mask of each field, or -1. It's empty if there is no child.
+  std::vector<int32_t> child_slots_;
+  // &internal::kTypeId<Msg> of the message type, or nullptr for an empty mask.
+  const void* type_ = nullptr;
+};
+
+}  // namespace liteproto
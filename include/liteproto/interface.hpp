@@ -5,12 +5,48 @@
 #pragma once
 
 #include <any>
+#include <optional>
 #include <type_traits>
 
 #include "liteproto/iterator.hpp"
 
 namespace liteproto {
 
+// ContiguousSpan is a view of the elements of a contiguous container (e.g., std::vector or std::string), so that the
+// elements can be accessed directly rather than through the proxies one by one. The descriptor is the one of the
+// element type.
+template <ConstOption Opt>
+class ContiguousSpan {
+ public:
+  using pointer = std::conditional_t<Opt == ConstOption::CONST, const void*, void*>;
+
+  ContiguousSpan(pointer data, size_t size, const TypeDescriptor& descriptor) noexcept
+      : data_(data), size_(size), descriptor_(&descriptor) {}
+
+  template <ConstOption RhsOpt, class = std::enable_if_t<Opt == ConstOption::CONST || RhsOpt == Opt>>
+  ContiguousSpan(const ContiguousSpan<RhsOpt>& rhs) noexcept : data_(rhs.data()), size_(rhs.size()), descriptor_(&rhs.Descriptor()) {}
+
+  [[nodiscard]] pointer data() const noexcept { return data_; }
+  [[nodiscard]] size_t size() const noexcept { return size_; }
+  [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+  [[nodiscard]] const TypeDescriptor& Descriptor() const noexcept { return *descriptor_; }
+
+  // Return nullptr if the elements are not of type Tp.
+  template <class Tp>
+  [[nodiscard]] auto As() const noexcept {
+    using result_type = std::conditional_t<Opt == ConstOption::CONST, const Tp*, Tp*>;
+    if (*descriptor_ != TypeMeta<std::remove_cv_t<Tp>>::GetDescriptor()) {
+      return static_cast<result_type>(nullptr);
+    }
+    return static_cast<result_type>(data_);
+  }
+
+ private:
+  pointer data_;
+  size_t size_;
+  const TypeDescriptor* descriptor_;
+};
+
 namespace internal {
 
 template <class Tp, class Pointer, class Reference,
@@ -21,6 +57,7 @@ template <class Tp, class Pointer, class Reference,
           class ConstTp = Tp, class ConstPointer = Pointer, class ConstReference = Reference>
 struct ListInterface {
   using iterator = Iterator<Tp, Pointer, Reference, std::bidirectional_iterator_tag>;
+  using random_access_iterator = Iterator<Tp, Pointer, Reference, std::random_access_iterator_tag>;
   using reference = Reference;
   static_assert(std::is_same_v<typename iterator::value_type, Tp>);
 
@@ -38,6 +75,15 @@ struct ListInterface {
   using clear_t = void(const std::any&);
   using begin_t = iterator(const std::any&) noexcept;
   using end_t = iterator(const std::any&) noexcept;
+  using random_access_begin_t = random_access_iterator(const std::any&) noexcept;
+  using random_access_end_t = random_access_iterator(const std::any&) noexcept;
+  using contiguous_t = std::optional<ContiguousSpan<ConstOption::NON_CONST>>(const std::any&) noexcept;
+  using assign_t = bool(const std::any&, const void*, std::size_t, const TypeDescriptor&);
+  using reserve_t = void(const std::any&, std::size_t);
+  using capacity_t = std::size_t(const std::any&) noexcept;
+  using shrink_to_fit_t = void(const std::any&);
+  using insert_range_t = iterator(const std::any&, iterator, const Tp*, std::size_t);
+  using append_t = void(const std::any&, const Tp*, std::size_t);
 
   using const_interface_t = const ListInterface<ConstTp, ConstPointer, ConstReference>&() noexcept;
   using to_const_t = std::any(const std::any&) noexcept;
@@ -56,6 +102,16 @@ struct ListInterface {
   clear_t* clear;
   begin_t* begin;
   end_t* end;
+  // nullptr if the underlying container is not random accessible.
+  random_access_begin_t* random_access_begin;
+  random_access_end_t* random_access_end;
+  contiguous_t* contiguous;
+  assign_t* assign;
+  reserve_t* reserve;
+  capacity_t* capacity;
+  shrink_to_fit_t* shrink_to_fit;
+  insert_range_t* insert_range;
+  append_t* append;
 
   const_interface_t* const_interface;
   to_const_t* to_const;
@@ -104,6 +160,9 @@ struct MapInterface {
   using clear_t = void(const std::any&);
   using begin_t = iterator(const std::any&) noexcept;
   using end_t = iterator(const std::any&) noexcept;
+  using insert_range_t = void(const std::any&, const Tp*, std::size_t);
+  using reserve_t = void(const std::any&, std::size_t);
+  using rehash_t = void(const std::any&, std::size_t);
 
   using const_interface_t = const MapInterface<ConstTp, ConstPointer, ConstReference>&() noexcept;
   using to_const_t = std::any(const std::any&) noexcept;
@@ -118,6 +177,9 @@ struct MapInterface {
   clear_t* clear;
   begin_t* begin;
   end_t* end;
+  insert_range_t* insert_range;
+  reserve_t* reserve;
+  rehash_t* rehash;
   const_interface_t* const_interface;
   to_const_t* to_const;
 };
@@ -194,6 +256,24 @@ struct MapInterfaceImpl {
   }
   static_assert(std::is_same_v<decltype(end), typename base::end_t>);
 
+  static void insert_range(const std::any& obj, const Tp* first, size_t n) {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    (*ptr).insert(first, n);
+  }
+  static_assert(std::is_same_v<decltype(insert_range), typename base::insert_range_t>);
+
+  static void reserve(const std::any& obj, size_t n) {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    (*ptr).reserve(n);
+  }
+  static_assert(std::is_same_v<decltype(reserve), typename base::reserve_t>);
+
+  static void rehash(const std::any& obj, size_t n) {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    (*ptr).rehash(n);
+  }
+  static_assert(std::is_same_v<decltype(rehash), typename base::rehash_t>);
+
   static std::any ToConst(const std::any& obj) noexcept {
     auto* ptr = std::any_cast<Adapter>(&obj);
     return (*ptr).ToConst();
@@ -213,6 +293,9 @@ struct MapInterfaceImpl {
       interface.clear = &clear;
       interface.begin = &begin;
       interface.end = &end;
+      interface.insert_range = &insert_range;
+      interface.reserve = &reserve;
+      interface.rehash = &rehash;
       interface.const_interface = &ConstInterface;
       interface.to_const = &ToConst;
       return interface;
@@ -237,6 +320,7 @@ template <class Adapter, class Tp, class Pointer, class Reference,
 struct ListInterfaceImpl {
   using base = ListInterface<Tp, Pointer, Reference, ConstTp, ConstPointer, ConstReference>;
   using iterator = typename base::iterator;
+  using random_access_iterator = typename base::random_access_iterator;
   using reference = typename base::reference;
 
   static void push_back(const std::any& obj, const Tp& v) {
@@ -323,6 +407,60 @@ struct ListInterfaceImpl {
   }
   static_assert(std::is_same_v<decltype(end), typename base::end_t>);
 
+  static random_access_iterator random_access_begin(const std::any& obj) noexcept {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    return (*ptr).random_access_begin();
+  }
+  static_assert(std::is_same_v<decltype(random_access_begin), typename base::random_access_begin_t>);
+
+  static random_access_iterator random_access_end(const std::any& obj) noexcept {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    return (*ptr).random_access_end();
+  }
+  static_assert(std::is_same_v<decltype(random_access_end), typename base::random_access_end_t>);
+
+  static std::optional<ContiguousSpan<ConstOption::NON_CONST>> contiguous(const std::any& obj) noexcept {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    return (*ptr).contiguous();
+  }
+  static_assert(std::is_same_v<decltype(contiguous), typename base::contiguous_t>);
+
+  static bool assign(const std::any& obj, const void* data, size_t n, const TypeDescriptor& descriptor) {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    return (*ptr).assign(data, n, descriptor);
+  }
+  static_assert(std::is_same_v<decltype(assign), typename base::assign_t>);
+
+  static void reserve(const std::any& obj, size_t n) {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    (*ptr).reserve(n);
+  }
+  static_assert(std::is_same_v<decltype(reserve), typename base::reserve_t>);
+
+  static size_t capacity(const std::any& obj) noexcept {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    return (*ptr).capacity();
+  }
+  static_assert(std::is_same_v<decltype(capacity), typename base::capacity_t>);
+
+  static void shrink_to_fit(const std::any& obj) {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    (*ptr).shrink_to_fit();
+  }
+  static_assert(std::is_same_v<decltype(shrink_to_fit), typename base::shrink_to_fit_t>);
+
+  static iterator insert_range(const std::any& obj, iterator pos, const Tp* first, size_t n) {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    return (*ptr).insert(std::move(pos), first, n);
+  }
+  static_assert(std::is_same_v<decltype(insert_range), typename base::insert_range_t>);
+
+  static void append(const std::any& obj, const Tp* first, size_t n) {
+    auto* ptr = std::any_cast<Adapter>(&obj);
+    (*ptr).append(first, n);
+  }
+  static_assert(std::is_same_v<decltype(append), typename base::append_t>);
+
   static std::any ToConst(const std::any& obj) noexcept {
     auto* ptr = std::any_cast<Adapter>(&obj);
     return (*ptr).ToConst();
@@ -346,6 +484,17 @@ struct ListInterfaceImpl {
       interface.clear = &clear;
       interface.begin = &begin;
       interface.end = &end;
+      if constexpr (Adapter::is_random_access) {
+        interface.random_access_begin = &random_access_begin;
+        interface.random_access_end = &random_access_end;
+      }
+      interface.contiguous = &contiguous;
+      interface.assign = &assign;
+      interface.reserve = &reserve;
+      interface.capacity = &capacity;
+      interface.shrink_to_fit = &shrink_to_fit;
+      interface.insert_range = &insert_range;
+      interface.append = &append;
       interface.const_interface = &ConstInterface;
       interface.to_const = &ToConst;
       return interface;
@@ -4,7 +4,9 @@
 
 #pragma once
 
-#include <any>
+#include <cstring>
+#include <iterator>
+#include <new>
 #include <type_traits>
 
 #include "liteproto/reflect/number.hpp"
@@ -34,35 +36,51 @@ namespace internal {
 template <class Container, class Tp, class Pointer, class Reference, class Category, class RefAdapter>
 class IteratorAdapter;
 
+// The wrapped iterator is stored inline in the Iterator, so that making or copying an Iterator never allocates. It is
+// large enough for the iterators of all the STL containers (the largest is the iterator of std::deque) along with the
+// container pointer.
+inline constexpr size_t kIteratorInlineSize = 6 * sizeof(void*);
+
+// All the functions of the interface take the address of the inline storage, which holds an iterator adapter of the
+// same type for both sides of a binary function.
 template <class Tp, class Pointer, class Reference, class Category>
 struct IteratorInterface {
  public:
   using pointer = Pointer;
   using reference = Reference;
 
-  using indirection_t = reference(const std::any&) noexcept;
-  using member_of_object_t = pointer(const std::any&) noexcept;
-  using increment_t = void(std::any&);
-  using decrement_t = void(std::any&);
-  using noteq_t = bool(const std::any&, const Iterator<Tp, pointer, reference, Category>&) noexcept;
+  using indirection_t = reference(const void*) noexcept;
+  using member_of_object_t = pointer(const void*) noexcept;
+  using increment_t = void(void*);
+  using decrement_t = void(void*);
+  using noteq_t = bool(const void*, const void*) noexcept;
+  using advance_t = void(void*, std::ptrdiff_t);
+  using distance_t = std::ptrdiff_t(const void*, const void*) noexcept;
+  using copy_t = void(void*, const void*) noexcept;
+  using destroy_t = void(void*) noexcept;
 
-  using adapter_type_id_t = uint64_t(const std::any&) noexcept;
   indirection_t* indirection;
   member_of_object_t* member_of_object;
   increment_t* increment;
   decrement_t* decrement;
   noteq_t* noteq;
-  adapter_type_id_t* adapter_type_id;
+  // Only for random access iterators.
+  advance_t* advance;
+  distance_t* distance;
+  // nullptr if the adapter is trivially copyable (destructible), so the storage is copied by a memcpy.
+  copy_t* copy;
+  destroy_t* destroy;
 };
 
 template <class Category, class IteratorAdapter, class Tp, class Pointer, class Reference>
 auto MakeIterator(IteratorAdapter&& it, const internal::IteratorInterface<Tp, Pointer, Reference, Category>& inter) noexcept;
 
-template <class Tp, class Pointer, class Reference, class Category>
-std::any& GetIteratorAdapter(Iterator<Tp, Pointer, Reference, Category>&) noexcept;
+template <class IteratorAdapter, class Tp, class Pointer, class Reference, class Category>
+IteratorAdapter* GetIteratorAdapter(Iterator<Tp, Pointer, Reference, Category>&) noexcept;
 
-template <class Tp, class Pointer, class Reference, class Category>
-const std::any& GetIteratorAdapter(const Iterator<Tp, Pointer, Reference, Category>&) noexcept;
+template <class It>
+auto GetIteratorInterface() noexcept
+    -> const IteratorInterface<typename It::value_type, typename It::pointer, typename It::reference, typename It::iterator_category>&;
 
 }  // namespace internal
 
@@ -80,35 +98,66 @@ class IteratorBase {
 
   using interface = internal::IteratorInterface<value_type, pointer, reference, iterator_category>;
 
-  reference operator*() noexcept { return interface_->indirection(it_); }
+  reference operator*() const noexcept { return interface_->indirection(&storage_); }
 
   iterator& operator++() {
-    interface_->increment(it_);
+    interface_->increment(&storage_);
     return static_cast<iterator&>(*this);
   }
   iterator operator++(int) {
-    Iterator old{*this};
+    iterator old{static_cast<iterator&>(*this)};
     ++(*this);
     return old;
   }
 
-  [[nodiscard]] uint64_t AdapterTypeId() const noexcept { return interface_->adapter_type_id(it_); }
-
-  IteratorBase() = default;
-  IteratorBase(const IteratorBase&) = default;
-  IteratorBase(IteratorBase&&) noexcept = default;
-  IteratorBase& operator=(const IteratorBase&) = default;
-  IteratorBase& operator=(IteratorBase&&) noexcept = default;
+  IteratorBase() noexcept : storage_{}, interface_(nullptr) {}
+  IteratorBase(const IteratorBase& rhs) noexcept : interface_(rhs.interface_) { CopyFrom(rhs); }
+  IteratorBase& operator=(const IteratorBase& rhs) noexcept {
+    if (this != &rhs) {
+      Destroy();
+      interface_ = rhs.interface_;
+      CopyFrom(rhs);
+    }
+    return *this;
+  }
+  ~IteratorBase() { Destroy(); }
 
  protected:
   template <class ItAdapter>
-  IteratorBase(ItAdapter&& it, const interface& inter) noexcept : it_(std::forward<ItAdapter>(it)), interface_(&inter) {
+  IteratorBase(ItAdapter&& it, const interface& inter) noexcept : interface_(&inter) {
+    using adapter_type = std::decay_t<ItAdapter>;
+    static_assert(sizeof(adapter_type) <= sizeof(storage_) && alignof(adapter_type) <= alignof(std::max_align_t),
+                  "The iterator adapter is too large to be stored inline");
+    ::new (static_cast<void*>(&storage_)) adapter_type(std::forward<ItAdapter>(it));
     static_assert(std::is_copy_constructible<IteratorBase>::value);
     static_assert(std::is_copy_assignable<IteratorBase>::value);
     static_assert(std::is_swappable<IteratorBase>::value);
   }
 
-  std::any it_;
+  // Two iterators are comparable only if they hold the same type of adapter, which is known by the interface because
+  // there is a single interface for each adapter type.
+  [[nodiscard]] bool NotEq(const IteratorBase& rhs) const noexcept {
+    if (interface_ != rhs.interface_) {
+      return true;
+    }
+    return interface_ != nullptr && interface_->noteq(&storage_, &rhs.storage_);
+  }
+
+  void CopyFrom(const IteratorBase& rhs) noexcept {
+    if (interface_ != nullptr && interface_->copy != nullptr) {
+      interface_->copy(&storage_, &rhs.storage_);
+    } else {
+      std::memcpy(&storage_, &rhs.storage_, sizeof storage_);
+    }
+  }
+
+  void Destroy() noexcept {
+    if (interface_ != nullptr && interface_->destroy != nullptr) {
+      interface_->destroy(&storage_);
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char storage_[internal::kIteratorInlineSize];
   const interface* interface_;
 };
 
@@ -117,8 +166,7 @@ class IteratorCategoryBase : public IteratorBase<Tp, Pointer, Reference, Categor
   using base = IteratorBase<Tp, Pointer, Reference, Category>;
 
  protected:
-  template <class... Args>
-  IteratorCategoryBase(Args&&... args) noexcept : base(std::forward<Args>(args)...) {}
+  using base::base;
 };
 
 template <class Tp, class Pointer, class Reference>
@@ -128,18 +176,69 @@ class IteratorCategoryBase<Tp, Pointer, Reference, std::bidirectional_iterator_t
 
  public:
   typename base::iterator& operator--() {
-    base::interface_->decrement(base::it_);
+    base::interface_->decrement(&this->storage_);
     return static_cast<typename base::iterator&>(*this);
   }
   typename base::iterator operator--(int) {
-    Iterator old{*this};
+    typename base::iterator old{static_cast<typename base::iterator&>(*this)};
+    --(*this);
+    return old;
+  }
+
+ protected:
+  using base::base;
+};
+
+// Only the iterators of a random access container (e.g., std::vector and std::deque) are made random access, so all the
+// operations are constant time.
+template <class Tp, class Pointer, class Reference>
+class IteratorCategoryBase<Tp, Pointer, Reference, std::random_access_iterator_tag>
+    : public IteratorBase<Tp, Pointer, Reference, std::random_access_iterator_tag> {
+  using base = IteratorBase<Tp, Pointer, Reference, std::random_access_iterator_tag>;
+  using iterator = typename base::iterator;
+
+ public:
+  iterator& operator--() {
+    base::interface_->decrement(&this->storage_);
+    return Self();
+  }
+  iterator operator--(int) {
+    iterator old{Self()};
     --(*this);
     return old;
   }
 
+  iterator& operator+=(typename base::difference_type n) {
+    base::interface_->advance(&this->storage_, n);
+    return Self();
+  }
+  iterator& operator-=(typename base::difference_type n) { return *this += -n; }
+
+  iterator operator+(typename base::difference_type n) const {
+    iterator it{Self()};
+    it += n;
+    return it;
+  }
+  iterator operator-(typename base::difference_type n) const { return *this + (-n); }
+  friend iterator operator+(typename base::difference_type n, const iterator& it) { return it + n; }
+
+  typename base::difference_type operator-(const IteratorCategoryBase& rhs) const noexcept {
+    return base::interface_->distance(&this->storage_, &rhs.storage_);
+  }
+
+  typename base::reference operator[](typename base::difference_type n) const { return *(*this + n); }
+
+  bool operator<(const IteratorCategoryBase& rhs) const noexcept { return (*this - rhs) < 0; }
+  bool operator>(const IteratorCategoryBase& rhs) const noexcept { return rhs < *this; }
+  bool operator<=(const IteratorCategoryBase& rhs) const noexcept { return !(rhs < *this); }
+  bool operator>=(const IteratorCategoryBase& rhs) const noexcept { return !(*this < rhs); }
+
  protected:
-  template <class... Args>
-  IteratorCategoryBase(Args&&... args) noexcept : base(std::forward<Args>(args)...) {}
+  using base::base;
+
+ private:
+  iterator& Self() noexcept { return static_cast<iterator&>(*this); }
+  const iterator& Self() const noexcept { return static_cast<const iterator&>(*this); }
 };
 
 template <class Tp, class Pointer, class Reference, class Category>
@@ -147,14 +246,8 @@ class Iterator : public IteratorCategoryBase<Tp, Pointer, Reference, Category> {
   template <class C, class IteratorAdapter, class T, class P, class R>
   friend auto internal::MakeIterator(IteratorAdapter&& it, const internal::IteratorInterface<T, P, R, C>& inter) noexcept;
 
-  template <class T, class P, class R, class C>
-  friend std::any& internal::GetIteratorAdapter(Iterator<T, P, R, C>&) noexcept;
-
-  template <class T, class P, class R, class C>
-  friend const std::any& internal::GetIteratorAdapter(const Iterator<T, P, R, C>&) noexcept;
-
-  template <class Container, class T, class P, class R, class C, class RA>
-  friend class internal::IteratorAdapter;
+  template <class IteratorAdapter, class T, class P, class R, class C>
+  friend IteratorAdapter* internal::GetIteratorAdapter(Iterator<T, P, R, C>&) noexcept;
 
   friend class IteratorBase<Tp, Pointer, Reference, Category>;
   using base = IteratorBase<Tp, Pointer, Reference, Category>;
@@ -163,20 +256,15 @@ class Iterator : public IteratorCategoryBase<Tp, Pointer, Reference, Category> {
  public:
   Iterator() = default;
   Iterator(const Iterator&) = default;
-  Iterator(Iterator&&) noexcept = default;
   Iterator& operator=(const Iterator&) = default;
-  Iterator& operator=(Iterator&&) noexcept = default;
 
-  bool operator==(const Iterator& rhs) const noexcept { return !(*this != rhs); }
-  bool operator!=(const Iterator& rhs) const noexcept { return base::interface_->noteq(base::it_, rhs); }
-  typename base::pointer operator->() noexcept { return base::interface_->member_of_object(base::it_); }
+  bool operator==(const Iterator& rhs) const noexcept { return !base::NotEq(rhs); }
+  bool operator!=(const Iterator& rhs) const noexcept { return base::NotEq(rhs); }
+  typename base::pointer operator->() const noexcept { return base::interface_->member_of_object(&this->storage_); }
 
  private:
   template <class ItAdapter>
   Iterator(ItAdapter&& it, const typename base::interface& inter) noexcept : category_base(std::forward<ItAdapter>(it), inter) {}
-
-  explicit Iterator(const base& iterator) : category_base(iterator) {}
-  explicit Iterator(base&& iterator) noexcept : category_base(std::move(iterator)) {}
 };
 
 template <class Tp, class Reference, class Category>
@@ -185,14 +273,8 @@ class Iterator<Tp, internal::DummyPointer, Reference, Category>
   template <class C, class IteratorAdapter, class T, class P, class R>
   friend auto internal::MakeIterator(IteratorAdapter&& it, const internal::IteratorInterface<T, P, R, C>& inter) noexcept;
 
-  template <class T, class P, class R, class C>
-  friend std::any& internal::GetIteratorAdapter(Iterator<T, P, R, C>&) noexcept;
-
-  template <class T, class P, class R, class C>
-  friend const std::any& internal::GetIteratorAdapter(const Iterator<T, P, R, C>&) noexcept;
-
-  template <class Container, class T, class P, class R, class C, class RA>
-  friend class internal::IteratorAdapter;
+  template <class IteratorAdapter, class T, class P, class R, class C>
+  friend IteratorAdapter* internal::GetIteratorAdapter(Iterator<T, P, R, C>&) noexcept;
 
   friend class IteratorBase<Tp, internal::DummyPointer, Reference, Category>;
   using base = IteratorBase<Tp, internal::DummyPointer, Reference, Category>;
@@ -201,19 +283,14 @@ class Iterator<Tp, internal::DummyPointer, Reference, Category>
  public:
   Iterator() = default;
   Iterator(const Iterator&) = default;
-  Iterator(Iterator&&) noexcept = default;
   Iterator& operator=(const Iterator&) = default;
-  Iterator& operator=(Iterator&&) noexcept = default;
 
-  bool operator==(const Iterator& rhs) const noexcept { return !(*this != rhs); }
-  bool operator!=(const Iterator& rhs) const noexcept { return base::interface_->noteq(base::it_, rhs); }
+  bool operator==(const Iterator& rhs) const noexcept { return !base::NotEq(rhs); }
+  bool operator!=(const Iterator& rhs) const noexcept { return base::NotEq(rhs); }
 
  private:
   template <class ItAdapter>
   Iterator(ItAdapter&& it, const typename base::interface& inter) noexcept : category_base(std::forward<ItAdapter>(it), inter) {}
-
-  explicit Iterator(const base& iterator) : category_base(iterator) {}
-  explicit Iterator(base&& iterator) noexcept : category_base(std::move(iterator)) {}
 };
 
 namespace internal {
@@ -223,14 +300,13 @@ auto MakeIterator(IteratorAdapter&& it, const IteratorInterface<Tp, Pointer, Ref
   return Iterator<Tp, Pointer, Reference, Category>(std::forward<IteratorAdapter>(it), inter);
 }
 
-template <class Tp, class Pointer, class Reference, class Category>
-std::any& GetIteratorAdapter(Iterator<Tp, Pointer, Reference, Category>& iterator) noexcept {
-  return iterator.it_;
-}
-
-template <class Tp, class Pointer, class Reference, class Category>
-const std::any& GetIteratorAdapter(const Iterator<Tp, Pointer, Reference, Category>& iterator) noexcept {
-  return iterator.it_;
+// Return nullptr if the iterator doesn't hold an IteratorAdapter.
+template <class IteratorAdapter, class Tp, class Pointer, class Reference, class Category>
+IteratorAdapter* GetIteratorAdapter(Iterator<Tp, Pointer, Reference, Category>& iterator) noexcept {
+  if (iterator.interface_ != &GetIteratorInterface<IteratorAdapter>()) {
+    return nullptr;
+  }
+  return std::launder(reinterpret_cast<IteratorAdapter*>(&iterator.storage_));
 }
 
 template <class It, class Tp, class Pointer, class Reference, class Category>
@@ -239,41 +315,35 @@ struct IteratorInterfaceImpl {
   using pointer = typename base::pointer;
   using reference = typename base::reference;
 
-  static reference Indirection(const std::any& obj) noexcept {
-    auto* ptr = std::any_cast<It>(&obj);
-    return *(*ptr);
-  }
+  static const It& Get(const void* storage) noexcept { return *std::launder(reinterpret_cast<const It*>(storage)); }
+  static It& Get(void* storage) noexcept { return *std::launder(reinterpret_cast<It*>(storage)); }
+
+  static reference Indirection(const void* obj) noexcept { return *Get(obj); }
   static_assert(std::is_same_v<decltype(Indirection), typename base::indirection_t>);
 
-  static pointer MemberOfObject(const std::any& obj) noexcept {
-    auto* ptr = std::any_cast<It>(&obj);
-    return (*ptr).operator->();
-  }
+  static pointer MemberOfObject(const void* obj) noexcept { return Get(obj).operator->(); }
   static_assert(std::is_same_v<decltype(MemberOfObject), typename base::member_of_object_t>);
 
-  static void Increment(std::any& obj) {
-    auto* ptr = std::any_cast<It>(&obj);
-    (*ptr).Increment();
-  }
+  static void Increment(void* obj) { Get(obj).Increment(); }
   static_assert(std::is_same_v<decltype(Increment), typename base::increment_t>);
 
-  static void Decrement(std::any& obj) {
-    auto* ptr = std::any_cast<It>(&obj);
-    (*ptr).Decrement();
-  }
+  static void Decrement(void* obj) { Get(obj).Decrement(); }
   static_assert(std::is_same_v<decltype(Decrement), typename base::decrement_t>);
 
-  static bool NotEq(const std::any& obj, const Iterator<Tp, Pointer, Reference, Category>& rhs) noexcept {
-    auto* ptr = std::any_cast<It>(&obj);
-    return (*ptr) != rhs;
-  }
+  static bool NotEq(const void* obj, const void* rhs) noexcept { return Get(obj) != Get(rhs); }
   static_assert(std::is_same_v<decltype(NotEq), typename base::noteq_t>);
 
-  static uint64_t AdapterTypeId(const std::any& obj) noexcept {
-    auto* ptr = std::any_cast<It>(&obj);
-    return (*ptr).AdapterTypeId();
-  }
-  static_assert(std::is_same_v<decltype(AdapterTypeId), typename base::adapter_type_id_t>);
+  static void Advance(void* obj, std::ptrdiff_t n) { Get(obj).Advance(n); }
+  static_assert(std::is_same_v<decltype(Advance), typename base::advance_t>);
+
+  static std::ptrdiff_t Distance(const void* obj, const void* rhs) noexcept { return Get(obj).Distance(Get(rhs)); }
+  static_assert(std::is_same_v<decltype(Distance), typename base::distance_t>);
+
+  static void Copy(void* obj, const void* rhs) noexcept { ::new (obj) It(Get(rhs)); }
+  static_assert(std::is_same_v<decltype(Copy), typename base::copy_t>);
+
+  static void Destroy(void* obj) noexcept { Get(obj).~It(); }
+  static_assert(std::is_same_v<decltype(Destroy), typename base::destroy_t>);
 };
 
 template <class It>
@@ -284,14 +354,23 @@ auto GetIteratorInterface() noexcept
   using reference = typename It::reference;
   using iterator_category = typename It::iterator_category;
   using impl = IteratorInterfaceImpl<It, value_type, pointer, reference, iterator_category>;
-  static const IteratorInterface<value_type, pointer, reference, iterator_category> inter = [&] {
+  static constexpr IteratorInterface<value_type, pointer, reference, iterator_category> inter = [] {
     IteratorInterface<value_type, pointer, reference, iterator_category> interface {};
     interface.indirection = &impl::Indirection;
     interface.member_of_object = &impl::MemberOfObject;
     interface.increment = &impl::Increment;
     interface.decrement = &impl::Decrement;
     interface.noteq = &impl::NotEq;
-    interface.adapter_type_id = &impl::AdapterTypeId;
+    if constexpr (std::is_same_v<iterator_category, std::random_access_iterator_tag>) {
+      interface.advance = &impl::Advance;
+      interface.distance = &impl::Distance;
+    }
+    if constexpr (!std::is_trivially_copyable_v<It>) {
+      interface.copy = &impl::Copy;
+    }
+    if constexpr (!std::is_trivially_destructible_v<It>) {
+      interface.destroy = &impl::Destroy;
+    }
     return interface;
   }();
   return inter;
@@ -313,6 +392,11 @@ class IteratorAdapter {
   static_assert(std::is_same_v<std::invoke_result_t<RefAdapter, typename wrapped_iterator::reference>, Reference>);
 
  private:
+  static constexpr bool kRandomAccess =
+      std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<wrapped_iterator>::iterator_category>;
+  static_assert(kRandomAccess || !std::is_same_v<Category, std::random_access_iterator_tag>,
+                "a random access iterator must wrap the iterator of a random access container");
+
   static constexpr bool DecrementNoexceptHelper() noexcept {
     if constexpr (is_bidirectional_iterator_v<wrapped_iterator>) {
       return noexcept(--std::declval<wrapped_iterator&>());
@@ -323,13 +407,10 @@ class IteratorAdapter {
 
  public:
   explicit IteratorAdapter(const wrapped_iterator& it) noexcept(noexcept(wrapped_iterator{it})) : it_(it) {
-    //    static_assert(IsProxyTypeV<value_type> || std::is_same_v<value_type, typename container_type::value_type> ||
-    //                  std::is_same_v<value_type, const typename container_type::value_type>);
     static_assert(std::is_copy_constructible<IteratorAdapter>::value);
     static_assert(std::is_copy_assignable<IteratorAdapter>::value);
     static_assert(std::is_swappable<IteratorAdapter>::value);
   }
-  explicit IteratorAdapter(wrapped_iterator&& it) noexcept(noexcept(wrapped_iterator{std::move(it)})) : it_(std::move(it)) {}
 
   reference operator*() const noexcept(noexcept(*std::declval<wrapped_iterator&>())) { return RefAdapter{}(*it_); }
 
@@ -348,16 +429,11 @@ class IteratorAdapter {
     }
   }
 
-  bool operator!=(const Iterator<value_type, pointer, reference, iterator_category>& rhs) const noexcept {
-    if (AdapterTypeId() != rhs.AdapterTypeId()) {
-      return true;
-    }
-    auto any_iter = &rhs.it_;
-    auto rhs_it = std::any_cast<IteratorAdapter>(any_iter);
-    return it_ != rhs_it->it_;
-  }
+  // Only for random access iterators.
+  void Advance(std::ptrdiff_t n) { it_ += n; }
+  std::ptrdiff_t Distance(const IteratorAdapter& rhs) const noexcept { return it_ - rhs.it_; }
 
-  [[nodiscard]] uint64_t AdapterTypeId() const noexcept { return TypeMeta<IteratorAdapter>::Id(); }
+  bool operator!=(const IteratorAdapter& rhs) const noexcept { return it_ != rhs.it_; }
 
   template <class V>
   IteratorAdapter& InsertMyself(container_type* container, V&& v) {
@@ -367,6 +443,14 @@ class IteratorAdapter {
     return *this;
   }
 
+  template <class It>
+  IteratorAdapter& InsertMyself(container_type* container, It first, It last) {
+    if constexpr (!std::is_const_v<container_type>) {
+      it_ = container->insert(it_, first, last);
+    }
+    return *this;
+  }
+
   IteratorAdapter& EraseMyself(container_type* container) noexcept(noexcept(container->erase(std::declval<wrapped_iterator&>()))) {
     if constexpr (!std::is_const_v<container_type>) {
       it_ = container->erase(it_);
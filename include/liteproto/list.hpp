@@ -4,6 +4,12 @@
 
 #pragma once
 
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <vector>
+
 #include "liteproto/interface.hpp"
 #include "liteproto/iterator.hpp"
 #include "liteproto/reflect/object.hpp"
@@ -15,11 +21,31 @@ namespace liteproto {
 namespace internal {
 template <class Tp, bool Proxy = true, class = void>
 class ListAdapter;
+
+template <ConstOption Opt, class V>
+bool CopyContiguous(const std::optional<ContiguousSpan<Opt>>& span, V* out, size_t size) noexcept {
+  static_assert(std::is_trivially_copyable_v<V>);
+  if (!span.has_value() || span->size() > size) {
+    return false;
+  }
+  auto data = span->template As<V>();
+  if (data == nullptr) {
+    return false;
+  }
+  if (!span->empty()) {
+    std::memcpy(out, data, span->size() * sizeof(V));
+  }
+  return true;
 }
 
+}  // namespace internal
+
 template <class C, class = internal::ListAdapter<C>>
 auto AsList(C* container) noexcept;
 
+template <class Tp, ConstOption Opt>
+class ListCursor;
+
 template <class Tp>
 class List<Tp, ConstOption::NON_CONST> {
   template <class C, class>
@@ -37,7 +63,9 @@ class List<Tp, ConstOption::NON_CONST> {
   using const_value_type = typename const_traits::value_type;
   using const_pointer = typename const_traits::pointer;
   using const_reference = typename const_traits::reference;
+  // A List may wrap any container, so its iterator is only bidirectional, see random_access().
   using iterator = Iterator<value_type, pointer, reference, std::bidirectional_iterator_tag>;
+  using random_access_iterator = Iterator<value_type, pointer, reference, std::random_access_iterator_tag>;
   using interface = internal::ListInterface<value_type, pointer, reference, const_value_type, const_pointer, const_reference>;
 
   void push_back(const Tp& v) const { interface_->push_back(obj_, v); }
@@ -46,13 +74,24 @@ class List<Tp, ConstOption::NON_CONST> {
 
   iterator insert(iterator pos, const Tp& v) const { return interface_->insert(obj_, std::move(pos), v); }
   iterator insert(iterator pos, Tp&& v) const { return interface_->emplace_insert(obj_, std::move(pos), std::move(v)); }
+  // Insert the n values at first before pos in a single call. As push_back, the values are moved if they are proxies.
+  iterator insert(iterator pos, const Tp* first, size_t n) const { return interface_->insert_range(obj_, std::move(pos), first, n); }
+  void append(const Tp* first, size_t n) const { interface_->append(obj_, first, n); }
   iterator erase(iterator pos) const { return interface_->erase(obj_, pos); }
 
+  // Linear if the underlying container is not random accessible (e.g., std::list), use cursor() to index it in a loop.
   decltype(auto) operator[](size_t pos) const { return interface_->operator_subscript(obj_, pos); }
+  [[nodiscard]] ListCursor<Tp, ConstOption::NON_CONST> cursor() const { return ListCursor<Tp, ConstOption::NON_CONST>{*this}; }
 
   void resize(size_t count) const { return interface_->resize(obj_, count); }
   void resize(size_t count, const Tp& v) { return interface_->resize_append(obj_, count, v); }
 
+  // If the underlying container doesn't manage its capacity (e.g., std::list), reserve and shrink_to_fit do nothing, and
+  // the capacity is the size.
+  void reserve(size_t n) const { interface_->reserve(obj_, n); }
+  size_t capacity() const noexcept { return interface_->capacity(obj_); }
+  void shrink_to_fit() const { interface_->shrink_to_fit(obj_); }
+
   size_t size() const noexcept { return interface_->size(obj_); }
   bool empty() const noexcept { return interface_->empty(obj_); }
   void clear() const { return interface_->clear(obj_); }
@@ -60,6 +99,32 @@ class List<Tp, ConstOption::NON_CONST> {
   decltype(auto) begin() const { return interface_->begin(obj_); }
   decltype(auto) end() const { return interface_->end(obj_); }
 
+  // Return the random access iterators of [begin, end), or std::nullopt if the underlying container is not random
+  // accessible (e.g., std::list).
+  [[nodiscard]] std::optional<std::pair<random_access_iterator, random_access_iterator>> random_access() const noexcept {
+    if (interface_->random_access_begin == nullptr) {
+      return std::nullopt;
+    }
+    return std::make_pair(interface_->random_access_begin(obj_), interface_->random_access_end(obj_));
+  }
+
+  // Return std::nullopt if the underlying container is not contiguous.
+  [[nodiscard]] std::optional<ContiguousSpan<ConstOption::NON_CONST>> contiguous() const noexcept { return interface_->contiguous(obj_); }
+
+  // Copy all the elements to out, which has room for `size` elements. Return false if the container is not contiguous,
+  // the elements are not of type V, or there is no enough room.
+  template <class V>
+  bool CopyTo(V* out, size_t size) const noexcept {
+    return internal::CopyContiguous(contiguous(), out, size);
+  }
+
+  // Replace the elements with the `size` elements at data. Return false if the elements are not of type V.
+  template <class V>
+  bool AssignFrom(const V* data, size_t size) const {
+    static_assert(std::is_trivially_copyable_v<V>);
+    return interface_->assign(obj_, data, size, TypeMeta<std::remove_cv_t<V>>::GetDescriptor());
+  }
+
   List(const List& rhs) = default;
   List& operator=(const List&) = default;
   List(List&&) noexcept = default;
@@ -88,16 +153,45 @@ class List<Tp, ConstOption::CONST> {
   using pointer = typename traits::pointer;
   using reference = typename traits::reference;
   using iterator = Iterator<value_type, pointer, reference, std::bidirectional_iterator_tag>;
+  using random_access_iterator = Iterator<value_type, pointer, reference, std::random_access_iterator_tag>;
   using interface = internal::ListInterface<value_type, pointer, reference>;
 
+  // Linear if the underlying container is not random accessible (e.g., std::list), use cursor() to index it in a loop.
   decltype(auto) operator[](size_t pos) const noexcept { return interface_->operator_subscript(obj_, pos); }
+  [[nodiscard]] ListCursor<Tp, ConstOption::CONST> cursor() const { return ListCursor<Tp, ConstOption::CONST>{*this}; }
 
   size_t size() const noexcept { return interface_->size(obj_); }
   bool empty() const noexcept { return interface_->empty(obj_); }
+  size_t capacity() const noexcept { return interface_->capacity(obj_); }
 
   decltype(auto) begin() const noexcept { return interface_->begin(obj_); }
   decltype(auto) end() const noexcept { return interface_->end(obj_); }
 
+  // Return the random access iterators of [begin, end), or std::nullopt if the underlying container is not random
+  // accessible (e.g., std::list).
+  [[nodiscard]] std::optional<std::pair<random_access_iterator, random_access_iterator>> random_access() const noexcept {
+    if (interface_->random_access_begin == nullptr) {
+      return std::nullopt;
+    }
+    return std::make_pair(interface_->random_access_begin(obj_), interface_->random_access_end(obj_));
+  }
+
+  // Return std::nullopt if the underlying container is not contiguous.
+  [[nodiscard]] std::optional<ContiguousSpan<ConstOption::CONST>> contiguous() const noexcept {
+    auto span = interface_->contiguous(obj_);
+    if (!span.has_value()) {
+      return std::nullopt;
+    }
+    return ContiguousSpan<ConstOption::CONST>{*span};
+  }
+
+  // Copy all the elements to out, which has room for `size` elements. Return false if the container is not contiguous,
+  // the elements are not of type V, or there is no enough room.
+  template <class V>
+  bool CopyTo(V* out, size_t size) const noexcept {
+    return internal::CopyContiguous(contiguous(), out, size);
+  }
+
   List(const List& rhs) = default;
   List& operator=(const List&) = default;
   List(List&&) noexcept = default;
@@ -144,8 +238,66 @@ class List<const volatile Object, ConstOpt> {
   List() = delete;
 };
 
+// ListCursor indexes the elements of a List. It remembers the last visited position and steps from the nearest of the
+// begin, the last position and the end, so an index loop over a container which is not random accessible costs amortized
+// O(1) per element. A random access container is indexed directly.
+// The cursor is owned by the caller, so it's not shared by the copies of the List. Like an iterator, it must not be used
+// after the size of the container is changed, and it's not thread-safe.
+template <class Tp, ConstOption Opt>
+class ListCursor {
+  using list_type = List<Tp, Opt>;
+  using iterator = typename list_type::iterator;
+  using random_access_iterator = typename list_type::random_access_iterator;
+
+ public:
+  explicit ListCursor(const list_type& list) : size_(list.size()) {
+    if (auto range = list.random_access(); range.has_value()) {
+      first_ = std::move(range->first);
+    } else {
+      begin_ = list.begin();
+      end_ = list.end();
+      it_ = begin_;
+    }
+  }
+
+  decltype(auto) operator[](size_t index) {
+    if (first_.has_value()) {
+      return (*first_)[static_cast<std::ptrdiff_t>(index)];
+    }
+    size_t distance = index < pos_ ? pos_ - index : index - pos_;
+    if (index < distance) {
+      it_ = begin_;
+      pos_ = 0;
+      distance = index;
+    }
+    if (size_ - index < distance) {
+      it_ = end_;
+      pos_ = size_;
+    }
+    std::advance(it_, static_cast<std::ptrdiff_t>(index) - static_cast<std::ptrdiff_t>(pos_));
+    pos_ = index;
+    return *it_;
+  }
+
+  [[nodiscard]] size_t size() const noexcept { return size_; }
+
+ private:
+  std::optional<random_access_iterator> first_;
+  iterator begin_;
+  iterator end_;
+  iterator it_;
+  size_t pos_ = 0;
+  size_t size_;
+};
+
 namespace internal {
 
+template <class C, class = void>
+struct IsContiguous : std::false_type {};
+
+template <class C>
+struct IsContiguous<C, std::enable_if_t<std::is_pointer_v<decltype(std::declval<C&>().data())>>> : std::true_type {};
+
 template <class Tp, bool Proxy>
 class ListAdapter<Tp, Proxy, std::enable_if_t<IsListV<Tp>>> {
   static_assert(!std::is_reference_v<Tp>);
@@ -155,6 +307,9 @@ class ListAdapter<Tp, Proxy, std::enable_if_t<IsListV<Tp>>> {
   using container_type = typename list_traits::container_type;
   using underlying_value_type = typename list_traits::value_type;
   static inline constexpr bool is_const = std::is_const_v<container_type>;
+  static inline constexpr bool is_random_access =
+      std::is_base_of_v<std::random_access_iterator_tag,
+                        typename std::iterator_traits<decltype(std::declval<container_type&>().begin())>::iterator_category>;
 
  private:
   using traits = std::conditional_t<Proxy,  // If it doesn't proxy, keep the original type
@@ -172,12 +327,16 @@ class ListAdapter<Tp, Proxy, std::enable_if_t<IsListV<Tp>>> {
   using const_pointer = typename const_traits::pointer;
   using const_reference = typename const_traits::reference;
   using iterator = Iterator<value_type, pointer, reference, std::bidirectional_iterator_tag>;
+  using random_access_iterator = Iterator<value_type, pointer, reference, std::random_access_iterator_tag>;
 
   // What is the ListAdapter for Object supposed to do?
   // It still directly accesses the indirect object inside the class. Only if when visiting through the methods,
   // the adapter creates an Object instance as the proxy of underlying indirect object.
-  using iterator_adapter = IteratorAdapter<container_type, value_type, pointer, reference, std::bidirectional_iterator_tag,
-                                           std::conditional_t<Proxy, MakeProxyWrapper<reference>, IdentityWrapper>>;
+  using ref_adapter = std::conditional_t<Proxy, MakeProxyWrapper<reference>, IdentityWrapper>;
+  using iterator_adapter = IteratorAdapter<container_type, value_type, pointer, reference, std::bidirectional_iterator_tag, ref_adapter>;
+  // Only for the random access containers.
+  using random_access_adapter =
+      IteratorAdapter<container_type, value_type, pointer, reference, std::random_access_iterator_tag, ref_adapter>;
   using const_adapter = ListAdapter<const Tp, Proxy, void>;
 
   explicit ListAdapter(container_type* c) noexcept : container_(c) {
@@ -211,9 +370,9 @@ class ListAdapter<Tp, Proxy, std::enable_if_t<IsListV<Tp>>> {
   }
 
   // operator[] could be either const or non-const.
+  // Linear if the container is not random accessible, see ListCursor.
   reference operator[](size_t pos) const {
-    using std::begin;
-    auto it = begin(*container_);
+    auto it = container_->begin();
     std::advance(it, pos);
     if constexpr (IsProxyTypeV<reference>) {
       return MakeProxy<reference>(*it);
@@ -253,6 +412,81 @@ class ListAdapter<Tp, Proxy, std::enable_if_t<IsListV<Tp>>> {
     }
   }
 
+  void reserve(size_t n) const {
+    if constexpr (!is_const && has_reserve_v<container_type>) {
+      container_->reserve(n);
+    }
+  }
+
+  size_t capacity() const noexcept {
+    if constexpr (has_capacity_v<std::remove_cv_t<container_type>>) {
+      return container_->capacity();
+    } else {
+      return container_->size();
+    }
+  }
+
+  void shrink_to_fit() const {
+    if constexpr (!is_const && has_shrink_to_fit_v<container_type>) {
+      container_->shrink_to_fit();
+    }
+  }
+
+  template <class Value>
+  iterator insert(iterator pos, const Value* first, size_t n) const {
+    if constexpr (!is_const) {
+      auto rhs_it = internal::GetIteratorAdapter<iterator_adapter>(pos);
+      if (rhs_it == nullptr) {
+        return end();
+      }
+      if constexpr (IsProxyTypeV<value_type>) {
+        auto values = RestoreRange(first, n);
+        rhs_it->InsertMyself(container_, std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()));
+      } else {
+        rhs_it->InsertMyself(container_, first, first + n);
+      }
+      return pos;
+    }
+    return end();
+  }
+
+  template <class Value>
+  void append(const Value* first, size_t n) const {
+    if constexpr (!is_const) {
+      if constexpr (IsProxyTypeV<value_type>) {
+        auto values = RestoreRange(first, n);
+        container_->insert(container_->end(), std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()));
+      } else {
+        container_->insert(container_->end(), first, first + n);
+      }
+    }
+  }
+
+  std::optional<ContiguousSpan<ConstOption::NON_CONST>> contiguous() const noexcept {
+    using element_type = std::remove_cv_t<underlying_value_type>;
+    if constexpr (IsContiguous<container_type>::value) {
+      auto data = const_cast<element_type*>(container_->data());
+      return ContiguousSpan<ConstOption::NON_CONST>{data, container_->size(), TypeMeta<element_type>::GetDescriptor()};
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  bool assign(const void* data, size_t n, const TypeDescriptor& descriptor) const {
+    using element_type = std::remove_cv_t<underlying_value_type>;
+    if constexpr (is_const || !std::is_trivially_copyable_v<element_type>) {
+      // If the container is const, do nothing. And it's assured that this method will never be called.
+      return false;
+    } else {
+      if (descriptor != TypeMeta<element_type>::GetDescriptor()) {
+        return false;
+      }
+      auto first = static_cast<const element_type*>(data);
+      container_->assign(first, first + n);
+      return true;
+    }
+  }
+
   iterator begin() const noexcept {
     iterator_adapter it_adapter{container_->begin()};
     return internal::MakeIterator(std::move(it_adapter), GetIteratorInterface<decltype(it_adapter)>());
@@ -263,13 +497,22 @@ class ListAdapter<Tp, Proxy, std::enable_if_t<IsListV<Tp>>> {
     return internal::MakeIterator(std::move(it_adapter), GetIteratorInterface<decltype(it_adapter)>());
   }
 
+  random_access_iterator random_access_begin() const noexcept {
+    random_access_adapter it_adapter{container_->begin()};
+    return internal::MakeIterator(std::move(it_adapter), GetIteratorInterface<decltype(it_adapter)>());
+  }
+
+  random_access_iterator random_access_end() const noexcept {
+    random_access_adapter it_adapter{container_->end()};
+    return internal::MakeIterator(std::move(it_adapter), GetIteratorInterface<decltype(it_adapter)>());
+  }
+
   template <class Value>
   iterator insert(iterator pos, Value&& v) const {
     if constexpr (is_const) {
       // If the container is const, do nothing. And it's assured that this method will never be called.
     } else {
-      auto& any_iter = internal::GetIteratorAdapter(pos);
-      auto rhs_it = std::any_cast<iterator_adapter>(&any_iter);
+      auto rhs_it = internal::GetIteratorAdapter<iterator_adapter>(pos);
       if (rhs_it == nullptr) {
         return end();
       }
@@ -289,8 +532,7 @@ class ListAdapter<Tp, Proxy, std::enable_if_t<IsListV<Tp>>> {
   iterator erase(iterator pos) const {
     // If the container is const, do nothing. And it's assured that this method will never be called.
     if constexpr (!is_const) {
-      auto& any_iter = internal::GetIteratorAdapter(pos);
-      auto rhs_it = std::any_cast<iterator_adapter>(&any_iter);
+      auto rhs_it = internal::GetIteratorAdapter<iterator_adapter>(pos);
       if (rhs_it != nullptr) {
         rhs_it->EraseMyself(container_);
         return pos;
@@ -302,6 +544,20 @@ class ListAdapter<Tp, Proxy, std::enable_if_t<IsListV<Tp>>> {
   [[nodiscard]] std::any ToConst() const noexcept { return const_adapter{container_}; }
 
  protected:
+  // The values which cannot be restored are skipped, as push_back does.
+  template <class Value>
+  static std::vector<underlying_value_type> RestoreRange(const Value* first, size_t n) {
+    std::vector<underlying_value_type> values;
+    values.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      auto real_v = RestoreFromProxy<underlying_value_type>(first[i]);
+      if (real_v.has_value()) {
+        values.push_back(std::move(*real_v));
+      }
+    }
+    return values;
+  }
+
   container_type* container_;
 };
 
@@ -312,6 +568,8 @@ auto AsList(C* container) noexcept {
   internal::ListAdapter<C> adapter{container};
 
   static_assert(std::is_trivially_copyable_v<decltype(adapter)>);
+  // Fits in the small buffer of std::any, so making a List never allocates.
+  static_assert(sizeof(adapter) == sizeof(void*));
 
   using value_type = typename internal::ListAdapter<C>::value_type;
   constexpr auto const_opt = static_cast<ConstOption>(std::is_const_v<C>);
@@ -4,8 +4,15 @@
 
 #pragma once
 
+// The arena needs <memory_resource>, which comes with GCC 9 or newer.
+#if __has_include(<memory_resource>)
+#include "liteproto/arena.hpp"
+#endif
+#include "liteproto/compare.hpp"
 #include "liteproto/message.hpp"
+#include "liteproto/message_pool.hpp"
 #include "liteproto/reflect.hpp"
+#include "liteproto/serialize/patch.hpp"
 #include "liteproto/serialize/resolver.hpp"
 
 #define MESSAGE(msg_name) class msg_name : public liteproto::MessageBase<msg_name, __LINE__>
@@ -18,10 +25,22 @@
   name##_;                                                                                                                         \
                                                                                                                                    \
  public:                                                                                                                           \
-  constexpr const decltype(name##_)& name() const { return name##_; }                                                              \
-  decltype(name##_)& mutable_##name() { return name##_; }                                                                          \
-  void set_##name(const decltype(name##_)& v) { name##_ = v; }                                                                     \
-  void set_##name(decltype(name##_)&& v) { name##_ = std::move(v); }                                                               \
+  constexpr const decltype(name##_)& name() const {                                                                                \
+    this->LazyDecode(liteproto::int32_constant<__LINE__>{});                                                                       \
+    return name##_;                                                                                                                \
+  }                                                                                                                                \
+  decltype(name##_)& mutable_##name() {                                                                                            \
+    this->LazyDecode(liteproto::int32_constant<__LINE__>{});                                                                       \
+    return name##_;                                                                                                                \
+  }                                                                                                                                \
+  void set_##name(const decltype(name##_)& v) {                                                                                    \
+    this->LazyDiscard(liteproto::int32_constant<__LINE__>{});                                                                      \
+    name##_ = v;                                                                                                                   \
+  }                                                                                                                                \
+  void set_##name(decltype(name##_)&& v) {                                                                                         \
+    this->LazyDiscard(liteproto::int32_constant<__LINE__>{});                                                                      \
+    name##_ = std::move(v);                                                                                                        \
+  }                                                                                                                                \
   static constexpr decltype(auto) FIELD_name(liteproto::int32_constant<__LINE__>) { return #name; }                                \
   constexpr auto FIELD_ptr(liteproto::int32_constant<__LINE__>) const noexcept { return &std::decay_t<decltype(*this)>::name##_; } \
   constexpr decltype(name##_)& FIELD_value(liteproto::int32_constant<__LINE__>) { return name##_; }                                \
@@ -53,11 +53,17 @@ class Map<K, V, ConstOption::NON_CONST> {
   iterator find(const key_type& key) const { return interface_->find(obj_, key); }
   iterator erase(iterator pos) const { return interface_->erase(obj_, pos); }
   size_t erase(const key_type& key) const { return interface_->erase_key(obj_, key); }
+  // Insert the n values at first in a single call. As insert, the values are moved if they are proxies.
+  void insert(const value_type* first, size_t n) const { interface_->insert_range(obj_, first, n); }
 
   size_t size() const noexcept { return interface_->size(obj_); }
   bool empty() const noexcept { return interface_->empty(obj_); }
   void clear() const { return interface_->clear(obj_); }
 
+  // Only the hash maps (e.g., std::unordered_map) manage their buckets, reserve and rehash do nothing for the others.
+  void reserve(size_t n) const { interface_->reserve(obj_, n); }
+  void rehash(size_t n) const { interface_->rehash(obj_, n); }
+
   decltype(auto) begin() const { return interface_->begin(obj_); }
   decltype(auto) end() const { return interface_->end(obj_); }
 
@@ -180,18 +186,18 @@ class MapAdapter<Tp, std::enable_if_t<IsMapV<Tp>>> {
     if constexpr (is_const) {
       return std::make_pair(end(), false);
     } else {
-      if constexpr (IsProxyTypeV<value_type>) {
+      if constexpr (IsProxyTypeV<key_type> || IsProxyTypeV<mapped_type>) {
         auto value = RestoreFromProxy<underlying_mapped_type>(std::forward<Value>(v).second);
         if (value.has_value()) {
           if (auto key = RestoreFromProxy<underlying_key_type>(std::forward<Value>(v).first); key.has_value()) {
-            auto [iter, ok] = container_->insert(std::make_pair(std::move(key), std::move(value)));
+            auto [iter, ok] = container_->emplace(std::move(*key), std::move(*value));
             return std::make_pair(MakeIterator(iter), ok);
           } else if (auto const_key = RestoreFromProxy<const underlying_key_type>(std::forward<Value>(v).first); const_key.has_value()) {
-            auto [iter, ok] = container_->insert(std::make_pair(const_key, std::move(value)));
+            auto [iter, ok] = container_->emplace(*const_key, std::move(*value));
             return std::make_pair(MakeIterator(iter), ok);
           }
-          return std::make_pair(end(), false);
         }
+        return std::make_pair(end(), false);
       } else {
         auto [iter, ok] = container_->insert(std::forward<Value>(v));
         return std::make_pair(MakeIterator(iter), ok);
@@ -199,6 +205,28 @@ class MapAdapter<Tp, std::enable_if_t<IsMapV<Tp>>> {
     }
   }
 
+  template <class Value>
+  void insert(const Value* first, size_t n) const {
+    if constexpr (!is_const) {
+      reserve(container_->size() + n);
+      for (size_t i = 0; i < n; ++i) {
+        insert(first[i]);
+      }
+    }
+  }
+
+  void reserve(size_t n) const {
+    if constexpr (!is_const && has_reserve_v<container_type>) {
+      container_->reserve(n);
+    }
+  }
+
+  void rehash(size_t n) const {
+    if constexpr (!is_const && has_rehash_v<container_type>) {
+      container_->rehash(n);
+    }
+  }
+
   iterator find(const key_type& key) const {
     auto iter = container_->end();
     if constexpr (IsObjectV<key_type>) {
@@ -224,8 +252,7 @@ class MapAdapter<Tp, std::enable_if_t<IsMapV<Tp>>> {
   iterator erase(iterator pos) const {
     // If the container is const, do nothing. And it's assured that this method will never be called.
     if constexpr (!is_const) {
-      auto& any_iter = internal::GetIteratorAdapter(pos);
-      auto rhs_it = std::any_cast<iterator_adapter>(&any_iter);
+      auto rhs_it = internal::GetIteratorAdapter<iterator_adapter>(pos);
       if (rhs_it != nullptr) {
         rhs_it->EraseMyself(container_);
         return pos;
@@ -5,33 +5,180 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <iostream>
-#include <map>
+#include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
+#include "liteproto/field_mask.hpp"
 #include "liteproto/reflect/object.hpp"
 #include "liteproto/reflect/type.hpp"
+#include "liteproto/serialize/binary.hpp"
 #include "liteproto/utils.hpp"
 
 namespace liteproto {
 
+template <class Tp>
+class MessageResolver;
+
+namespace internal {
+
+// The cached size is a relaxed atomic, so serializing a const message from several threads at the same time is not a
+// data race, since every thread stores the same value. A copied message has to measure its size again.
+class CachedSize {
+ public:
+  CachedSize() noexcept = default;
+  CachedSize(const CachedSize&) noexcept {}
+  CachedSize& operator=(const CachedSize&) noexcept { return *this; }
+
+  [[nodiscard]] size_t Get() const noexcept { return size_.load(std::memory_order_relaxed); }
+  void Set(size_t size) noexcept { size_.store(size, std::memory_order_relaxed); }
+
+ private:
+  std::atomic<size_t> size_{0};
+};
+
+// The records of the fields which are not decoded yet, see MessageBase::ParseLazyFromArray(). The adjacent records of
+// the same field are merged into a single span, so a repeated field usually takes only one span.
+// The spans are allocated by the first Add(), so a message which is never parsed lazily only pays for a null pointer,
+// and its const accessors never write anything.
+class LazyFields {
+ public:
+  struct Span {
+    int32_t index;
+    const char* begin;
+    const char* end;
+  };
+
+  LazyFields() = default;
+  // A copy keeps the spans, which refer to the same input.
+  LazyFields(const LazyFields& rhs) : spans_(rhs.empty() ? nullptr : new std::vector<Span>(*rhs.spans_)) {}
+  LazyFields(LazyFields&& rhs) noexcept : spans_(std::exchange(rhs.spans_, nullptr)) {}
+  LazyFields& operator=(const LazyFields& rhs) {
+    LazyFields copy(rhs);
+    std::swap(spans_, copy.spans_);
+    return *this;
+  }
+  LazyFields& operator=(LazyFields&& rhs) noexcept {
+    std::swap(spans_, rhs.spans_);
+    return *this;
+  }
+  ~LazyFields() { delete spans_; }
+
+  // A raw pointer rather than std::unique_ptr, so the check can be called from the constexpr accessors.
+  [[nodiscard]] constexpr bool empty() const noexcept { return spans_ == nullptr; }
+
+  void Add(int32_t index, const char* begin, const char* end) {
+    if (spans_ == nullptr) {
+      spans_ = new std::vector<Span>();
+    }
+    if (!spans_->empty() && spans_->back().index == index && spans_->back().end == begin) {
+      spans_->back().end = end;
+    } else {
+      spans_->push_back(Span{index, begin, end});
+    }
+  }
+
+  // Remove the spans of the given field and return them in the order of the input.
+  std::vector<Span> Take(int32_t index) {
+    std::vector<Span> taken;
+    if (spans_ == nullptr) {
+      return taken;
+    }
+    size_t kept = 0;
+    for (const auto& span : *spans_) {
+      if (span.index == index) {
+        taken.push_back(span);
+      } else {
+        (*spans_)[kept++] = span;
+      }
+    }
+    spans_->resize(kept);
+    if (kept == 0) {
+      Clear();
+    }
+    return taken;
+  }
+
+  [[nodiscard]] int32_t FirstIndex() const noexcept { return spans_->front().index; }
+
+  [[nodiscard]] size_t Size(int32_t index) const noexcept {
+    size_t size = 0;
+    if (spans_ != nullptr) {
+      for (const auto& span : *spans_) {
+        size += span.index == index ? static_cast<size_t>(span.end - span.begin) : 0;
+      }
+    }
+    return size;
+  }
+
+  char* Write(int32_t index, char* p) const noexcept {
+    if (spans_ != nullptr) {
+      for (const auto& span : *spans_) {
+        if (span.index == index) {
+          p = WriteBytes(span.begin, static_cast<size_t>(span.end - span.begin), p);
+        }
+      }
+    }
+    return p;
+  }
+
+  void Clear() noexcept {
+    delete spans_;
+    spans_ = nullptr;
+  }
+
+ private:
+  std::vector<Span>* spans_ = nullptr;
+};
+
+}  // namespace internal
+
+namespace internal {
+template <class Tp, class>
+struct JsonCodec;
+template <class Msg>
+struct PatchCodec;
+}  // namespace internal
+
 class Message {
  public:
+  virtual ~Message() = default;
+
   virtual Object Field(size_t index) = 0;
-  virtual Object Field(const std::string& name) = 0;
+  virtual Object Field(std::string_view name) = 0;
   virtual Object Field(size_t index) const = 0;
-  virtual Object Field(const std::string& name) const = 0;
-  virtual const std::string& FieldName(size_t index) const = 0;
-  virtual bool HasName(const std::string& name) const = 0;
+  virtual Object Field(std::string_view name) const = 0;
+  virtual std::string_view FieldName(size_t index) const = 0;
+  virtual bool HasName(std::string_view name) const = 0;
   virtual size_t FieldsSize() const noexcept = 0;
 };
 
+// MessageBase implements a message declared by MESSAGE(). A message is not thread-safe unless it's only read, and a
+// lazily parsed message (see ParseLazyFromArray()) is not even that: a const access (e.g., x(), Field(i), DumpTuple()
+// or ByteSize(mask)) may decode a field in place, so such a message must not be shared across threads without a lock,
+// or until all its fields are decoded. The other messages keep only a null pointer for the lazy fields, and their const
+// accesses never write, except the atomic cached size.
 template <class Msg, int32_t Line>
 class MessageBase : public Message {
   friend constexpr decltype(auto) internal::GetAllFields<Msg>();
   friend constexpr decltype(auto) internal::GetAllFields2<Msg>();
 
+  template <class, class>
+  friend struct internal::ValueCodec;
+  template <class, class>
+  friend struct internal::JsonCodec;
+  template <class>
+  friend struct internal::PatchCodec;
+  template <class>
+  friend class MessageResolver;
+  template <class, int32_t>
+  friend class MessageBase;
+  friend class FieldMask;
+
   static constexpr int32_t FIELDS_start = Line;
 
   struct FieldsIndices {
@@ -42,51 +189,283 @@ class MessageBase : public Message {
 #endif
   };
 
-  struct VariantType {
-   private:
+  // Dispatch a record to the field with the same seq number, through the tables which are built at compile time.
+  struct FieldsParser {
+    using parser_type = const char* (*)(Msg*, WireType, const char*, const char*);
     static constexpr auto indices = FieldsIndices::value;
-    template <size_t... I>
-    static auto VariantTypeHelper(std::index_sequence<I...>)
-        -> std::variant<decltype(std::declval<Msg>().FIELD_ptr(int32_constant<indices[I].second>{}))...>;
+    static constexpr auto seq_table = internal::MakeSeqTable<internal::SeqTableSize(indices)>(indices);
+    static constexpr auto parsers = MessageBase::MakeParsers(std::make_index_sequence<indices.size()>{});
+    // Whether a field can be decoded lazily, i.e., an embedded message or a repeated field.
+    static constexpr auto lazy = MessageBase::MakeLazyMask(std::make_index_sequence<indices.size()>{});
+    using lazy_decoder_type = void (*)(Msg*, const char*, const char*);
+    static constexpr auto lazy_decoders = MessageBase::MakeLazyDecoders(std::make_index_sequence<indices.size()>{});
+    // Parse an embedded message with the mask of its fields, and resolve the paths into an embedded message.
+    using masked_parser_type = const char* (*)(Msg*, WireType, const char*, const char*, const FieldMask&);
+    static constexpr auto masked_parsers = MessageBase::MakeMaskedParsers(std::make_index_sequence<indices.size()>{});
+    using mask_resolver_type = bool (*)(FieldMask*, std::string_view);
+    static constexpr auto mask_resolvers = MessageBase::MakeMaskResolvers(std::make_index_sequence<indices.size()>{});
+
+    static constexpr int32_t Find(int32_t seq) noexcept {
+      if constexpr (seq_table.size() != 0) {
+        return static_cast<size_t>(seq) < seq_table.size() ? seq_table[seq] : -1;
+      } else {
+        return internal::BinarySearchSeq(indices, seq);
+      }
+    }
+  };
+
+  // The accessors of the fields in the order of FieldsIndices, which are shared by all the instances. Each accessor
+  // makes the Object of a field from the address of the message, i.e., the offset of the field is compiled into it.
+  struct FieldsReflector {
+    static constexpr auto value =
+        MessageBase::MakeReflectors(static_cast<Msg*>(nullptr), std::make_index_sequence<FieldsIndices::value.size()>{});
+    static constexpr auto const_value =
+        MessageBase::MakeReflectors(static_cast<const Msg*>(nullptr), std::make_index_sequence<FieldsIndices::value.size()>{});
+  };
+
+  // The thunks of Visit() in the order of FieldsIndices. Msg_ is either Msg or const Msg.
+  template <class Msg_, class Fn>
+  struct FieldsVisitor {
+    static constexpr auto value = MessageBase::MakeVisitors(static_cast<Msg_*>(nullptr), static_cast<Fn*>(nullptr),
+                                                            std::make_index_sequence<FieldsIndices::value.size()>{});
+  };
 
-   public:
-    using type = decltype(VariantTypeHelper(std::make_index_sequence<FieldsIndices::value.size()>{}));
+  // The field names in the order of FieldsIndices, and a perfect hash table over them. If there is no perfect hash
+  // within the bounded search of FindPerfectHash() (e.g., for more than a few dozen fields), the names are binary searched.
+  struct FieldsNames {
+    static constexpr auto value = MessageBase::MakeFieldsNames(std::make_index_sequence<FieldsIndices::value.size()>{});
+    static_assert(!internal::HasDuplicateKeys(value), "the names of the fields must be distinct");
+    static constexpr auto hash_params = internal::FindPerfectHash(value);
+    static constexpr auto table = internal::MakeStringTable<value.size(), hash_params.size>(value, hash_params.seed);
   };
 
  public:
-  [[nodiscard]] auto DumpTuple() const noexcept { return DumpTupleImpl(std::make_index_sequence<FieldsIndices::value.size()>{}); }
-  [[nodiscard]] auto DumpTuple() noexcept { return DumpTupleImpl(std::make_index_sequence<FieldsIndices::value.size()>{}); }
+  // Decode all the lazy fields first, which may allocate.
+  [[nodiscard]] auto DumpTuple() const {
+    DecodeLazyFields();
+    return DumpTupleImpl(std::make_index_sequence<FieldsIndices::value.size()>{});
+  }
+  [[nodiscard]] auto DumpTuple() {
+    DecodeLazyFields();
+    return DumpTupleImpl(std::make_index_sequence<FieldsIndices::value.size()>{});
+  }
 
+  // Call fn(value) with the field at the index, do nothing if the index is out of range. The call is dispatched through
+  // a table of per-field thunks, one table for each type of fn.
   template <class Fn>
   void Visit(size_t index, Fn&& fn) {
-    std::visit([this, fn = std::forward<Fn>(fn)](auto&& ptr) {
-      auto& msg = static_cast<Msg&>(*this);
-      fn(msg.*ptr);
-    }, VariantArr()[index]);
+    if (index >= FieldsIndices::value.size()) {
+      return;
+    }
+    DecodeLazyField(static_cast<int32_t>(index));
+    FieldsVisitor<Msg, std::remove_reference_t<Fn>>::value[index](static_cast<Msg*>(this), fn);
+  }
+  template <class Fn>
+  void Visit(size_t index, Fn&& fn) const {
+    if (index >= FieldsIndices::value.size()) {
+      return;
+    }
+    DecodeLazyField(static_cast<int32_t>(index));
+    FieldsVisitor<const Msg, std::remove_reference_t<Fn>>::value[index](static_cast<const Msg*>(this), fn);
   }
 
+  // Call fn(name, seq, value) for each field in the order of FieldsIndices. The loop is unrolled at compile time, so
+  // fn is instantiated and inlined with the exact type of each field.
+  template <class Fn>
+  void ForEachField(Fn&& fn) {
+    DecodeLazyFields();
+    ForEachFieldImpl(static_cast<Msg*>(this), fn, std::make_index_sequence<FieldsIndices::value.size()>{});
+  }
+  template <class Fn>
+  void ForEachField(Fn&& fn) const {
+    DecodeLazyFields();
+    ForEachFieldImpl(static_cast<const Msg*>(this), fn, std::make_index_sequence<FieldsIndices::value.size()>{});
+  }
+
+  // Return an empty Object if the index is out of range.
   Object Field(size_t index) override {
-    [[maybe_unused]] static const bool dummy = ApplyReflectForEachField(static_cast<Msg*>(this), &fields_);
-    return fields_.at(FieldsIndices::value[index].first);
+    if (index >= FieldsIndices::value.size()) {
+      return Object{};
+    }
+    DecodeLazyField(static_cast<int32_t>(index));
+    return FieldsReflector::value[index](static_cast<Msg*>(this));
+  }
+  // The name is looked up through the perfect hash (or the sorted table) over the field names, which is built at compile
+  // time.
+  Object Field(std::string_view name) override {
+    int32_t index = FindFieldByName(name);
+    return index < 0 ? Object{} : Field(static_cast<size_t>(index));
   }
-  Object Field(const std::string& name) override { return Field(fields_name_.at(name)); }
 
   Object Field(size_t index) const override {
-    [[maybe_unused]] static const bool dummy = ApplyReflectForEachField(static_cast<const Msg*>(this), &const_fields_);
-    return const_fields_.at(FieldsIndices::value[index].first);
+    if (index >= FieldsIndices::value.size()) {
+      return Object{};
+    }
+    DecodeLazyField(static_cast<int32_t>(index));
+    return FieldsReflector::const_value[index](static_cast<const Msg*>(this));
+  }
+  Object Field(std::string_view name) const override {
+    int32_t index = FindFieldByName(name);
+    return index < 0 ? Object{} : Field(static_cast<size_t>(index));
   }
-  Object Field(const std::string& name) const override { return Field(fields_name_.at(name)); }
 
-  const std::string& FieldName(size_t index) const override { return fields_name_inverse_.at(index); }
-  bool HasName(const std::string& name) const override { return fields_name_.count(name); }
+  // Return an empty name if the index is out of range.
+  std::string_view FieldName(size_t index) const override {
+    return index < FieldsNames::value.size() ? FieldsNames::value[index] : std::string_view{};
+  }
+  bool HasName(std::string_view name) const override { return FindFieldByName(name) >= 0; }
 
   size_t FieldsSize() const noexcept override { return FieldsIndices::value.size(); }
 
+  // Return the exact size of the serialized message. The sizes of this message and all the embedded messages are cached,
+  // so the following serialization writes the length prefixes without measuring them again.
+  // Like the serialization, it must not be called concurrently on the same message.
+  [[nodiscard]] size_t ByteSize() const noexcept {
+    size_t size = InternalByteSizeImpl(std::make_index_sequence<FieldsIndices::value.size()>{});
+    cached_size_.Set(size);
+    return size;
+  }
+
+  // Return the size computed by the last ByteSize(), which is stale if the message has been modified since then.
+  [[nodiscard]] size_t GetCachedSize() const noexcept { return cached_size_.Get(); }
+
+  // Serialize the message in the protobuf wire format. The seq number of each field is used as its field number.
+  // The output is allocated only once with the exact size.
+  [[nodiscard]] std::string SerializeAsString() const {
+    std::string output;
+    SerializeToString(&output);
+    return output;
+  }
+
+  bool SerializeToString(std::string* output) const {
+    size_t size = ByteSize();
+    output->resize(size);
+    InternalSerialize(output->data());
+    return true;
+  }
+
+  // Return false if the given buffer is not large enough.
+  bool SerializeToArray(void* data, size_t size) const {
+    if (ByteSize() > size) {
+      return false;
+    }
+    InternalSerialize(static_cast<char*>(data));
+    return true;
+  }
+
+  // Like ByteSize(), but only the fields selected by the mask are counted. The lazy embedded messages with a child mask
+  // are decoded, since only their selected fields are counted. A mask of another message type selects no field.
+  [[nodiscard]] size_t ByteSize(const FieldMask& mask) const {
+    if (!mask.IsFor<Msg>()) {
+      cached_size_.Set(0);
+      return 0;
+    }
+    size_t size = InternalMaskedByteSizeImpl(mask, std::make_index_sequence<FieldsIndices::value.size()>{});
+    cached_size_.Set(size);
+    return size;
+  }
+
+  // Serialize the fields selected by the mask. Nothing is serialized if the mask is built for another message type, in
+  // which case SerializeToString() returns false.
+  [[nodiscard]] std::string SerializeAsString(const FieldMask& mask) const {
+    std::string output;
+    SerializeToString(&output, mask);
+    return output;
+  }
+
+  bool SerializeToString(std::string* output, const FieldMask& mask) const {
+    if (!mask.IsFor<Msg>()) {
+      output->clear();
+      return false;
+    }
+    size_t size = ByteSize(mask);
+    output->resize(size);
+    InternalMaskedSerialize(output->data(), mask);
+    return true;
+  }
+
+  // Serialize the message into a buffer of at least GetCachedSize() bytes, return the position next to the output.
+  // It must follow a ByteSize() of the unmodified message.
+  char* SerializeWithCachedSizesToArray(void* data) const noexcept { return InternalSerialize(static_cast<char*>(data)); }
+
+  // Parse the message from the protobuf wire format, all the fields are cleared first. The unknown fields are dropped.
+  // Return false if the input is malformed, in which case the message may be partially parsed.
+  // The std::string_view fields point into the input rather than copy it, so the input must outlive the message.
+  bool ParseFromArray(const void* data, size_t size) {
+    InternalClear();
+    return MergeFromArray(data, size);
+  }
+
+  bool ParseFromString(std::string_view data) { return ParseFromArray(data.data(), data.size()); }
+
+  // Parse the fields selected by the mask, the records of the other fields are skipped without being decoded.
+  // Return false if the mask is built for another message type.
+  bool ParseFromArray(const void* data, size_t size, const FieldMask& mask) {
+    InternalClear();
+    if (!mask.IsFor<Msg>()) {
+      return false;
+    }
+    auto begin = static_cast<const char*>(data);
+    return InternalMerge(begin, begin + size, &mask) != nullptr;
+  }
+
+  bool ParseFromString(std::string_view data, const FieldMask& mask) { return ParseFromArray(data.data(), data.size(), mask); }
+
+  // Like ParseFromArray, but the embedded messages and the repeated fields only keep their records, which are decoded on
+  // the first access through x(), mutable_x(), Field(i), Visit() or DumpTuple(). The embedded messages are parsed lazily
+  // as well. The records of the undecoded fields are copied as is by the serialization, so forwarding a message only
+  // costs the decoding of the fields which are actually read.
+  // The input must outlive the message. The records are only checked to be well-framed, a malformed payload is found
+  // and dropped at the decoding. Since even a const access may decode a field, a lazily parsed message must not be
+  // accessed concurrently.
+  bool ParseLazyFromArray(const void* data, size_t size) {
+    InternalClear();
+    auto begin = static_cast<const char*>(data);
+    return InternalMerge<true>(begin, begin + size) != nullptr;
+  }
+
+  bool ParseLazyFromString(std::string_view data) { return ParseLazyFromArray(data.data(), data.size()); }
+
+  // Reset all the fields to the default values. The strings and the containers are cleared rather than replaced, so
+  // their capacity is kept, and decoding into a cleared message reuses the memory. The records of a lazy parsing are
+  // dropped.
+  void Clear() { InternalClear(); }
+
+  // Like ParseFromArray, but the message is not cleared. The singular fields are overwritten and the repeated fields
+  // are appended.
+  bool MergeFromArray(const void* data, size_t size) {
+    auto begin = static_cast<const char*>(data);
+    return InternalMerge(begin, begin + size) != nullptr;
+  }
+
   template <class Tp, class Fn>
   static constexpr auto ForEach(Fn&& fn) noexcept {
     return ForEachImpl<Tp>(std::make_index_sequence<FieldsIndices::value.size()>{}, std::forward<Fn>(fn));
   }
 
+ protected:
+  // Called by the accessors of the field declared at line L.
+  template <int32_t L>
+  constexpr void LazyDecode(int32_constant<L>) const {
+    constexpr int32_t index = FindFieldByLine(L);
+    if constexpr (FieldsParser::lazy[index]) {
+      if (!lazy_.empty()) {
+        DecodeLazyField(index);
+      }
+    }
+  }
+
+  // Called by the setters, the records are dropped since the value is overwritten.
+  template <int32_t L>
+  constexpr void LazyDiscard(int32_constant<L>) {
+    constexpr int32_t index = FindFieldByLine(L);
+    if constexpr (FieldsParser::lazy[index]) {
+      if (!lazy_.empty()) {
+        lazy_.Take(index);
+      }
+    }
+  }
+
  private:
   template <size_t I = 0, size_t N>
   static constexpr auto GetFieldIndexByName(const char (&str)[N]) {
@@ -114,63 +493,318 @@ class MessageBase : public Message {
     return std::forward_as_tuple(msg.FIELD_value(int32_constant<indices[I].second>{})...);
   }
 
+  // The sizes of the embedded messages must have been cached by ByteSize().
+  char* InternalSerialize(char* p) const noexcept {
+    return InternalSerializeImpl(p, std::make_index_sequence<FieldsIndices::value.size()>{});
+  }
+
   template <size_t... I>
-  [[nodiscard]] static constexpr auto MakeVariantArrImpl(std::index_sequence<I...>) noexcept {
-    return std::array{MakeVariant<I>()...};
+  [[nodiscard]] size_t InternalByteSizeImpl(std::index_sequence<I...>) const noexcept {
+    constexpr auto indices = FieldsIndices::value;
+    [[maybe_unused]] auto tuple = DumpTupleImpl(std::index_sequence<I...>{});
+    if (lazy_.empty()) {
+      return (size_t{0} + ... + internal::FieldByteSize(indices[I].first, std::get<I>(tuple)));
+    }
+    return (size_t{0} + ... + LazyFieldByteSize<I>(std::get<I>(tuple)));
   }
 
-  template <size_t I>
-  static constexpr auto MakeVariant() noexcept {
-    using var_t = typename VariantType::type;
+  template <size_t... I>
+  char* InternalSerializeImpl(char* p, std::index_sequence<I...>) const noexcept {
     constexpr auto indices = FieldsIndices::value;
-    auto pseudo_obj = static_cast<Msg*>(nullptr);
-    return var_t{pseudo_obj->FIELD_ptr(int32_constant<indices[I].second>{})};
+    [[maybe_unused]] auto tuple = DumpTupleImpl(std::index_sequence<I...>{});
+    if (lazy_.empty()) {
+      ((p = internal::WriteField(indices[I].first, std::get<I>(tuple), p)), ...);
+    } else {
+      ((p = WriteLazyField<I>(std::get<I>(tuple), p)), ...);
+    }
+    return p;
   }
 
-  template <class Tp, class Fn, size_t... I>
-  static constexpr auto ForEachImpl(std::index_sequence<I...>, Fn&& fn) noexcept {
-    Tp res{};
-    (std::forward<Fn>(fn).template operator()<I>(&res), ...);
-    return res;
+  // An undecoded field still has the default value, since it's decoded before being modified. So it's either the
+  // records or the value that is serialized.
+  template <size_t I, class Tp>
+  [[nodiscard]] size_t LazyFieldByteSize(const Tp& field) const noexcept {
+    if constexpr (FieldsParser::lazy[I]) {
+      if (size_t size = lazy_.Size(I); size != 0) {
+        return size;
+      }
+    }
+    return internal::FieldByteSize(FieldsIndices::value[I].first, field);
   }
 
-  struct GetName {
-    template <size_t I>
-    void operator()(std::map<std::string, size_t>* field_name) noexcept {
-      constexpr auto index = FieldsIndices::value[I];
-      (*field_name)[Msg::FIELD_name(int32_constant<index.second>{})] = I;
+  template <size_t I, class Tp>
+  char* WriteLazyField(const Tp& field, char* p) const noexcept {
+    if constexpr (FieldsParser::lazy[I]) {
+      if (lazy_.Size(I) != 0) {
+        return lazy_.Write(I, p);
+      }
     }
-  };
+    return internal::WriteField(FieldsIndices::value[I].first, field, p);
+  }
 
-  struct GetNameInverse {
-    template <size_t I>
-    void operator()(std::vector<std::string>* field_name) noexcept {
-      constexpr auto index = FieldsIndices::value[I];
-      field_name->emplace_back(Msg::FIELD_name(int32_constant<index.second>{}));
+  char* InternalMaskedSerialize(char* p, const FieldMask& mask) const noexcept {
+    return InternalMaskedSerializeImpl(p, mask, std::make_index_sequence<FieldsIndices::value.size()>{});
+  }
+
+  template <size_t... I>
+  [[nodiscard]] size_t InternalMaskedByteSizeImpl(const FieldMask& mask, std::index_sequence<I...>) const {
+    [[maybe_unused]] auto tuple = DumpTupleImpl(std::index_sequence<I...>{});
+    return (size_t{0} + ... + (mask.Test(I) ? MaskedFieldByteSize<I>(std::get<I>(tuple), mask.Child(I)) : 0));
+  }
+
+  template <size_t... I>
+  char* InternalMaskedSerializeImpl(char* p, const FieldMask& mask, std::index_sequence<I...>) const noexcept {
+    [[maybe_unused]] auto tuple = DumpTupleImpl(std::index_sequence<I...>{});
+    ((p = mask.Test(I) ? WriteMaskedField<I>(std::get<I>(tuple), mask.Child(I), p) : p), ...);
+    return p;
+  }
+
+  // An embedded message with a child mask is always emitted, even if none of its selected fields is set.
+  template <size_t I, class Tp>
+  [[nodiscard]] size_t MaskedFieldByteSize(const Tp& field, const FieldMask* child) const {
+    if constexpr (IsMessageV<Tp>) {
+      if (child != nullptr) {
+        DecodeLazyField(I);
+        constexpr auto tag = internal::MakeTag(FieldsIndices::value[I].first, WireType::LENGTH_DELIMITED);
+        return internal::VarintSize(tag) + internal::LengthDelimitedSize(field.ByteSize(*child));
+      }
     }
-  };
+    return LazyFieldByteSize<I>(field);
+  }
 
-  template <size_t I = 0, class Msg_>
-  static bool ApplyReflectForEachField(Msg_* msg, std::map<int32_t, Object>* field) {
-    if constexpr (I < FieldsIndices::value.size()) {
-      constexpr auto index = FieldsIndices::value[I];
-      field->insert(std::make_pair(index.first, GetReflection(&msg->FIELD_value(int32_constant<index.second>{}))));
-      return ApplyReflectForEachField<I + 1>(msg, field);
+  template <size_t I, class Tp>
+  char* WriteMaskedField(const Tp& field, const FieldMask* child, char* p) const noexcept {
+    if constexpr (IsMessageV<Tp>) {
+      if (child != nullptr) {
+        p = internal::WriteVarint(internal::MakeTag(FieldsIndices::value[I].first, WireType::LENGTH_DELIMITED), p);
+        p = internal::WriteVarint(field.GetCachedSize(), p);
+        return field.InternalMaskedSerialize(p, *child);
+      }
+    }
+    return WriteLazyField<I>(field, p);
+  }
+
+  // In the lazy mode, the records of the lazy fields are only framed and kept in lazy_. The records of the fields out
+  // of the mask are skipped.
+  template <bool Lazy = false>
+  const char* InternalMerge(const char* p, const char* end, const FieldMask* mask = nullptr) {
+    auto msg = static_cast<Msg*>(this);
+    while (p < end) {
+      const char* record = p;
+      int32_t seq;
+      WireType type;
+      p = internal::ReadTag(p, end, &seq, &type);
+      if (p == nullptr) {
+        return nullptr;
+      }
+      int32_t index = FieldsParser::Find(seq);
+      const FieldMask* child = nullptr;
+      if (index < 0 || (mask != nullptr && !mask->Test(index))) {
+        p = internal::SkipField(type, p, end);
+      } else if (mask != nullptr && (child = mask->Child(index)) != nullptr) {
+        p = FieldsParser::masked_parsers[index](msg, type, p, end, *child);
+      } else if (Lazy && FieldsParser::lazy[index]) {
+        if ((p = internal::SkipField(type, p, end)) != nullptr) {
+          lazy_.Add(index, record, p);
+        }
+      } else {
+        p = FieldsParser::parsers[index](msg, type, p, end);
+      }
+      if (p == nullptr) {
+        return nullptr;
+      }
+    }
+    return p;
+  }
+
+  void InternalClear() {
+    lazy_.Clear();
+    InternalClearImpl(std::make_index_sequence<FieldsIndices::value.size()>{});
+  }
+
+  template <size_t... I>
+  void InternalClearImpl(std::index_sequence<I...>) {
+    [[maybe_unused]] auto tuple = DumpTupleImpl(std::index_sequence<I...>{});
+    (internal::ClearField(&std::get<I>(tuple)), ...);
+  }
+
+  template <size_t I>
+  static const char* ParseField(Msg* msg, WireType type, const char* p, const char* end) {
+    constexpr auto index = FieldsIndices::value[I];
+    if constexpr (FieldsParser::lazy[I]) {
+      // The records kept by a lazy parsing come first.
+      if (!msg->lazy_.empty()) {
+        msg->DecodeLazyField(I);
+      }
+    }
+    return internal::ReadField(type, p, end, &msg->FIELD_value(int32_constant<index.second>{}));
+  }
+
+  // Only the embedded messages have a child mask.
+  template <size_t I>
+  static const char* ParseMaskedField(Msg* msg, WireType type, const char* p, const char* end, const FieldMask& mask) {
+    constexpr auto index = FieldsIndices::value[I];
+    auto& field = msg->FIELD_value(int32_constant<index.second>{});
+    if constexpr (IsMessageV<std::remove_reference_t<decltype(field)>>) {
+      size_t len;
+      if (type != WireType::LENGTH_DELIMITED) {
+        return internal::SkipField(type, p, end);
+      }
+      if ((p = internal::ReadLength(p, end, &len)) == nullptr) {
+        return nullptr;
+      }
+      return field.InternalMerge(p, p + len, &mask) == nullptr ? nullptr : p + len;
     } else {
-      return true;
+      return internal::SkipField(type, p, end);
+    }
+  }
+
+  // The fields are mutable for the decoding, like the cached size.
+  void DecodeLazyField(int32_t index) const {
+    if (lazy_.empty() || index < 0 || static_cast<size_t>(index) >= FieldsIndices::value.size() || !FieldsParser::lazy[index]) {
+      return;
+    }
+    auto msg = const_cast<Msg*>(static_cast<const Msg*>(this));
+    for (const auto& span : lazy_.Take(index)) {
+      FieldsParser::lazy_decoders[index](msg, span.begin, span.end);
     }
   }
 
-  static decltype(auto) VariantArr() noexcept {
-    static const auto arr = MakeVariantArrImpl(std::make_index_sequence<FieldsIndices::value.size()>{});
-    return arr;
+  void DecodeLazyFields() const {
+    while (!lazy_.empty()) {
+      DecodeLazyField(lazy_.FirstIndex());
+    }
   }
 
-  std::map<int32_t, Object> fields_;
-  mutable std::map<int32_t, Object> const_fields_;
+  // Decode the records of a lazy field. An embedded message is parsed lazily too.
+  template <size_t I>
+  static void DecodeLazySpan(Msg* msg, const char* p, const char* end) {
+    constexpr auto index = FieldsIndices::value[I];
+    auto& field = msg->FIELD_value(int32_constant<index.second>{});
+    while (p != nullptr && p < end) {
+      int32_t seq;
+      WireType type;
+      if ((p = internal::ReadTag(p, end, &seq, &type)) == nullptr) {
+        return;
+      }
+      if constexpr (IsMessageV<std::remove_reference_t<decltype(field)>>) {
+        size_t len;
+        if (type != WireType::LENGTH_DELIMITED) {
+          p = internal::SkipField(type, p, end);
+        } else if ((p = internal::ReadLength(p, end, &len)) != nullptr) {
+          p = field.template InternalMerge<true>(p, p + len) == nullptr ? nullptr : p + len;
+        }
+      } else {
+        p = internal::ReadField(type, p, end, &field);
+      }
+    }
+  }
 
-  static inline const std::map<std::string, size_t> fields_name_ = ForEach<std::map<std::string, size_t>>(GetName{});
-  static inline const std::vector<std::string> fields_name_inverse_ = ForEach<std::vector<std::string>>(GetNameInverse{});
+  static constexpr int32_t FindFieldByLine(int32_t line) noexcept {
+    constexpr auto indices = FieldsIndices::value;
+    for (size_t i = 0; i < indices.size(); i++) {
+      if (indices[i].second == line) {
+        return static_cast<int32_t>(i);
+      }
+    }
+    return -1;
+  }
+
+  // Return the index of the field with the given name, or -1 if there is no such field.
+  static constexpr int32_t FindFieldByName(std::string_view name) noexcept { return FieldsNames::table.Find(name); }
+
+  template <size_t... I>
+  static constexpr auto MakeFieldsNames(std::index_sequence<I...>) noexcept {
+    constexpr auto indices = FieldsIndices::value;
+    return std::array<std::string_view, sizeof...(I)>{std::string_view{Msg::FIELD_name(int32_constant<indices[I].second>{})}...};
+  }
+
+  template <size_t... I>
+  static constexpr auto MakeParsers(std::index_sequence<I...>) noexcept {
+    return std::array<typename FieldsParser::parser_type, sizeof...(I)>{&ParseField<I>...};
+  }
+
+  template <size_t... I>
+  static constexpr auto MakeLazyMask(std::index_sequence<I...>) noexcept {
+    constexpr auto indices = FieldsIndices::value;
+    return std::array<bool, sizeof...(I)>{IsLazyField<std::remove_reference_t<decltype(
+        std::declval<Msg&>().FIELD_value(int32_constant<indices[I].second>{}))>>()...};
+  }
+
+  template <size_t... I>
+  static constexpr auto MakeLazyDecoders(std::index_sequence<I...>) noexcept {
+    return std::array<typename FieldsParser::lazy_decoder_type, sizeof...(I)>{&DecodeLazySpan<I>...};
+  }
+
+  template <size_t... I>
+  static constexpr auto MakeMaskedParsers(std::index_sequence<I...>) noexcept {
+    return std::array<typename FieldsParser::masked_parser_type, sizeof...(I)>{&ParseMaskedField<I>...};
+  }
+
+  template <size_t... I>
+  static constexpr auto MakeMaskResolvers(std::index_sequence<I...>) noexcept {
+    return std::array<typename FieldsParser::mask_resolver_type, sizeof...(I)>{MakeMaskResolver<I>()...};
+  }
+
+  template <size_t I>
+  static constexpr auto MakeMaskResolver() noexcept {
+    constexpr auto index = FieldsIndices::value[I];
+    using field_type = std::remove_reference_t<decltype(std::declval<Msg&>().FIELD_value(int32_constant<index.second>{}))>;
+    if constexpr (IsMessageV<field_type>) {
+      return &FieldMask::AddChildPath<field_type>;
+    } else {
+      return static_cast<bool (*)(FieldMask*, std::string_view)>(nullptr);
+    }
+  }
+
+  template <class Tp>
+  static constexpr bool IsLazyField() noexcept {
+    return !IsStringV<Tp> && (IsMessageV<Tp> || IsListV<Tp> || IsMapV<Tp>);
+  }
+
+  template <size_t I, class Msg_, class Fn>
+  static void VisitField(Msg_* msg, Fn& fn) {
+    constexpr auto index = FieldsIndices::value[I];
+    fn(msg->FIELD_value(int32_constant<index.second>{}));
+  }
+
+  template <class Msg_, class Fn, size_t... I>
+  static constexpr auto MakeVisitors(Msg_*, Fn*, std::index_sequence<I...>) noexcept {
+    return std::array<void (*)(Msg_*, Fn&), sizeof...(I)>{&VisitField<I, Msg_, Fn>...};
+  }
+
+  template <class Msg_, class Fn, size_t... I>
+  static void ForEachFieldImpl(Msg_* msg, Fn& fn, std::index_sequence<I...>) {
+    constexpr auto indices = FieldsIndices::value;
+    (fn(FieldsNames::value[I], indices[I].first, msg->FIELD_value(int32_constant<indices[I].second>{})), ...);
+  }
+
+  template <class Tp, class Fn, size_t... I>
+  static constexpr auto ForEachImpl(std::index_sequence<I...>, Fn&& fn) noexcept {
+    Tp res{};
+    (std::forward<Fn>(fn).template operator()<I>(&res), ...);
+    return res;
+  }
+
+  template <size_t I, class Msg_>
+  static Object ReflectField(Msg_* msg) noexcept {
+    constexpr auto index = FieldsIndices::value[I];
+    return GetReflection(&msg->FIELD_value(int32_constant<index.second>{}));
+  }
+
+  template <class Msg_, size_t... I>
+  static constexpr auto MakeReflectors(Msg_*, std::index_sequence<I...>) noexcept {
+    return std::array<Object (*)(Msg_*), sizeof...(I)>{&ReflectField<I, Msg_>...};
+  }
+
+  mutable internal::CachedSize cached_size_;
+  mutable internal::LazyFields lazy_;
 };
 
+// Call fn(name, seq, value) for each field of the message, see MessageBase::ForEachField().
+template <class Msg, class Fn, class = std::enable_if_t<IsMessageV<std::remove_const_t<Msg>>>>
+void ForEachField(Msg& msg, Fn&& fn) {
+  msg.ForEachField(std::forward<Fn>(fn));
+}
+
 }  // namespace liteproto
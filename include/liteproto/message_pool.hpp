@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "liteproto/message.hpp"
+#include "liteproto/traits/traits.hpp"
+
+namespace liteproto {
+
+template <class Msg>
+class MessagePool;
+
+namespace internal {
+
+template <class Msg>
+struct MessagePoolDeleter {
+  void operator()(Msg* msg) const noexcept { MessagePool<Msg>::Release(msg); }
+};
+
+}  // namespace internal
+
+// MessagePool recycles the messages of a type in a per-thread free list. A released message is Clear()-ed, so the
+// strings and the containers keep their capacity, and a consumer that decodes into the acquired messages in a loop
+// reaches a steady state without allocations once the capacity is large enough.
+// A message may be released on another thread than the one acquiring it, it's cached by the releasing thread then. The
+// messages must not be released after the pool of the releasing thread is destroyed, i.e., during the thread exit.
+// The free list of a thread allocates its capacity on the first Acquire(), SetMaxSize() or Reserve() of the thread.
+// Release() never allocates, so it deletes the message if the free list has no room, e.g., on a thread that only
+// releases the messages.
+template <class Msg>
+class MessagePool {
+  static_assert(IsMessageV<Msg>);
+
+ public:
+  using pointer = std::unique_ptr<Msg, internal::MessagePoolDeleter<Msg>>;
+
+  static constexpr size_t kDefaultMaxSize = 64;
+
+  // Return a cached message, or a new one if the free list is empty. The message is returned to the pool when the
+  // pointer is destroyed.
+  [[nodiscard]] static pointer Acquire() {
+    auto& cached = Cached();
+    // Reserve the room for the message before it's released.
+    if (cached.messages.capacity() < cached.max_size) {
+      cached.messages.reserve(cached.max_size);
+    }
+    if (cached.messages.empty()) {
+      return pointer{new Msg()};
+    }
+    Msg* msg = cached.messages.back();
+    cached.messages.pop_back();
+    return pointer{msg};
+  }
+
+  // Clear the message and put it into the free list of this thread, or delete it if the free list is full.
+  static void Release(Msg* msg) noexcept {
+    if (msg == nullptr) {
+      return;
+    }
+    auto& cached = Cached();
+    if (cached.messages.size() >= cached.max_size || cached.messages.size() == cached.messages.capacity()) {
+      delete msg;
+      return;
+    }
+    msg->Clear();
+    cached.messages.push_back(msg);
+  }
+
+  // The number of the messages in the free list of this thread.
+  [[nodiscard]] static size_t Size() noexcept { return Cached().messages.size(); }
+
+  // Set the capacity of the free list of this thread, the extra messages are deleted.
+  static void SetMaxSize(size_t max_size) {
+    auto& cached = Cached();
+    cached.max_size = max_size;
+    cached.Shrink();
+    cached.messages.reserve(max_size);
+  }
+
+  // Fill the free list of this thread with new messages, up to the given number.
+  static void Reserve(size_t n) {
+    auto& cached = Cached();
+    while (cached.messages.size() < n && cached.messages.size() < cached.max_size) {
+      cached.messages.push_back(new Msg());
+    }
+  }
+
+ private:
+  struct FreeList {
+    FreeList() noexcept = default;
+    FreeList(const FreeList&) = delete;
+    FreeList& operator=(const FreeList&) = delete;
+    ~FreeList() {
+      max_size = 0;
+      Shrink();
+    }
+
+    void Shrink() noexcept {
+      while (messages.size() > max_size) {
+        delete messages.back();
+        messages.pop_back();
+      }
+    }
+
+    std::vector<Msg*> messages;
+    size_t max_size = kDefaultMaxSize;
+  };
+
+  static FreeList& Cached() noexcept {
+    static thread_local FreeList cached;
+    return cached;
+  }
+};
+
+}  // namespace liteproto
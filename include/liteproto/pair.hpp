@@ -15,9 +15,11 @@ template <class C, class = std::enable_if_t<IsPairV<C>>>
 auto AsPair(C* pair) noexcept {
   using first_type = typename ProxyType<typename PairTraits<C>::first_type>::type;
   using second_type = typename ProxyType<typename PairTraits<C>::second_type>::type;
-  constexpr bool is_const = std::is_const_v<C>;
-  using first_reference = typename InterfaceTraits<first_type, static_cast<ConstOption>(is_const)>::reference;
-  using second_reference = typename InterfaceTraits<second_type, static_cast<ConstOption>(is_const)>::reference;
+  // The members could be const by themselves, e.g., the std::pair<const Key, T> in a map.
+  constexpr bool is_first_const = std::is_const_v<C> || std::is_const_v<typename PairTraits<C>::first_type>;
+  constexpr bool is_second_const = std::is_const_v<C> || std::is_const_v<typename PairTraits<C>::second_type>;
+  using first_reference = typename InterfaceTraits<first_type, static_cast<ConstOption>(is_first_const)>::reference;
+  using second_reference = typename InterfaceTraits<second_type, static_cast<ConstOption>(is_second_const)>::reference;
   return std::make_pair(MakeProxy<first_reference>(pair->first), MakeProxy<second_reference>(pair->second));
 }
 
@@ -19,23 +19,47 @@
 
 namespace liteproto {
 
+namespace internal {
+
 template <class Tp>
-[[nodiscard]] Object GetReflection(Tp* v) noexcept {
-  constexpr ConstOption opt [[maybe_unused]] = std::is_const_v<Tp> ? ConstOption::CONST : ConstOption::NON_CONST;
+auto MakeObjectProxy(Tp* v) noexcept {
   if constexpr (IsNumberV<Tp> || (std::is_arithmetic_v<Tp>)) {
-    return Object(v, NumberReference(*v));
+    return NumberReference(*v);
   } else if constexpr (IsStringV<Tp>) {
-    return Object(v, AsString(v));
+    return AsString(v);
   } else if constexpr (IsListV<Tp>) {
-    return Object(v, AsList(v));
-  } else if constexpr (IsArrayV<Tp>) {
-    // TODO
+    return AsList(v);
   } else if constexpr (IsPairV<Tp>) {
-    return Object(v, AsPair(v));
+    return AsPair(v);
+  } else if constexpr (IsMessageV<Tp>) {
+    // The proxy of a message is the pointer to its Message base, through which the fields are reflected again.
+    return static_cast<MessagePointer<static_cast<ConstOption>(std::is_const_v<Tp>)>>(v);
+  } else if constexpr (IsMapV<Tp>) {
+    return AsMap(v);
+  }
+}
+
+template <class Tp>
+void MakeObjectProxyAt(const void* addr, void* result) noexcept {
+  using proxy_type = decltype(MakeObjectProxy(static_cast<Tp*>(nullptr)));
+  static_cast<std::optional<proxy_type>*>(result)->emplace(MakeObjectProxy(static_cast<Tp*>(const_cast<void*>(addr))));
+}
+
+template <class Tp>
+inline constexpr ObjectInterface kObjectInterface{&kTypeId<decltype(MakeObjectProxy(static_cast<Tp*>(nullptr)))>,
+                                                  &MakeObjectProxyAt<Tp>};
+
+}  // namespace internal
+
+template <class Tp>
+[[nodiscard]] Object GetReflection(Tp* v) noexcept {
+  if constexpr (IsNumberV<Tp> || (std::is_arithmetic_v<Tp>) || IsStringV<Tp> || IsListV<Tp> || IsPairV<Tp> || IsMessageV<Tp> ||
+                IsMapV<Tp>) {
+    return Object(v, &internal::kObjectInterface<Tp>);
   } else {
+    // TODO: Array
     return Object(v);
   }
-  std::abort();  // never enter
 }
 
 template <class Tp>
@@ -48,62 +72,40 @@ inline std::pair<Object, std::any> TypeMeta<Tp>::DefaultValue() noexcept {
   return std::make_pair(Object{}, std::any{});
 }
 
-template <class Tp>
-inline const TypeDescriptor& TypeMeta<Tp>::GetDescriptor() noexcept {
-  static const TypeDescriptor descriptor = [&] {
-    internal::DescriptorInterface inter{};
-    inter.id_ = &Id;
-    inter.size_of_ = &SizeOf;
-    inter.alignment_of_ = &AlignmentOf;
-    inter.rank_ = &Rank;
-    inter.extent_ = &Extent;
-    inter.transform_ = &Transform;
-    inter.type_enum_ = &TypeEnum;
-    inter.kind_enum_ = &KindEnum;
-    inter.traits_ = &Traits;
-    inter.transform_ = &Transform;
-
-    inter.value_type_ = &ValueType;
-    inter.first_type_ = &FirstType;
-    inter.second_type_ = &SecondType;
-
-    inter.is_indirect_type_ = &IsIndirectType;
-    inter.default_value_ = &DefaultValue;
-    return TypeDescriptor{inter};
-  }();
-  return descriptor;
-}
-
-inline std::pair<Object, std::any> TypeDescriptor::DefaultValue() const noexcept { return inter_.default_value_(); }
+inline std::pair<Object, std::any> TypeDescriptor::DefaultValue() const noexcept { return default_value_(); }
 
 template <class Tp, ConstOption Opt>
 std::optional<List<Tp, Opt>> ListCast(const Object& object) noexcept {
-  using return_type = std::optional<List<Tp, Opt>>;
-  auto indirect_ptr = std::any_cast<List<Tp, Opt>>(&object.interface_);
-  if (indirect_ptr == nullptr) {
-    return return_type{};
-  }
-  return return_type{*indirect_ptr};
+  return object.ProxyCast<List<Tp, Opt>>();
 }
 
 template <ConstOption Opt>
 std::optional<String<Opt>> StringCast(const Object& object) noexcept {
-  using return_type = std::optional<String<Opt>>;
-  auto indirect_ptr = std::any_cast<String<Opt>>(&object.interface_);
-  if (indirect_ptr == nullptr) {
-    return return_type{};
-  }
-  return return_type{*indirect_ptr};
+  return object.ProxyCast<String<Opt>>();
 }
 
 template <class First, class Second>
 std::optional<Pair<First, Second>> PairCast(const Object& object) noexcept {
-  using return_type = std::optional<Pair<First, Second>>;
-  auto indirect_ptr = std::any_cast<Pair<First, Second>>(&object.interface_);
-  if (indirect_ptr == nullptr) {
-    return return_type{};
+  return object.ProxyCast<Pair<First, Second>>();
+}
+
+template <class K, class V, ConstOption Opt>
+std::optional<Map<K, V, Opt>> MapCast(const Object& object) noexcept {
+  return object.ProxyCast<Map<K, V, Opt>>();
+}
+
+// Return nullptr if the object is not a message. A non-const message can be cast as const as well.
+template <ConstOption Opt>
+internal::MessagePointer<Opt> MessageCast(const Object& object) noexcept {
+  if (auto msg = object.ProxyCast<Message*>(); msg.has_value()) {
+    return *msg;
+  }
+  if constexpr (Opt == ConstOption::CONST) {
+    if (auto msg = object.ProxyCast<const Message*>(); msg.has_value()) {
+      return *msg;
+    }
   }
-  return return_type{*indirect_ptr};
+  return nullptr;
 }
 
 }  // namespace liteproto
\ No newline at end of file
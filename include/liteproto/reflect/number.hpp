@@ -4,16 +4,74 @@
 
 #pragma once
 
+#include <cstring>
+
 #include "liteproto/reflect/type.hpp"
 
 namespace liteproto {
 
+namespace internal {
+
+// NumberTag is the category and width of an arithmetic type, which is cached by Number and NumberReference when they
+// are constructed, so that the numeric access is a switch on it instead of an indirect call. NUMBER means a reference
+// to a Number, whose tag is only known at runtime.
+enum class NumberTag : uint8_t {
+  INT8,
+  INT16,
+  INT32,
+  INT64,
+  UINT8,
+  UINT16,
+  UINT32,
+  UINT64,
+  BOOLEAN,
+  FLOAT32,
+  FLOAT64,
+  LONG_DOUBLE,
+  NUMBER
+};
+
+template <class Tp>
+constexpr NumberTag MakeNumberTag() noexcept {
+  using removed_cv = std::remove_cv_t<Tp>;
+  if constexpr (IsNumberV<removed_cv>) {
+    return NumberTag::NUMBER;
+  } else if constexpr (std::is_same_v<removed_cv, bool>) {
+    return NumberTag::BOOLEAN;
+  } else if constexpr (std::is_floating_point_v<removed_cv>) {
+    if constexpr (std::is_same_v<removed_cv, float>) {
+      return NumberTag::FLOAT32;
+    } else if constexpr (std::is_same_v<removed_cv, double>) {
+      return NumberTag::FLOAT64;
+    } else {
+      return NumberTag::LONG_DOUBLE;
+    }
+  } else {
+    static_assert(std::is_integral_v<removed_cv> && sizeof(removed_cv) <= 8);
+    constexpr auto width = sizeof(removed_cv) == 1 ? 0 : sizeof(removed_cv) == 2 ? 1 : sizeof(removed_cv) == 4 ? 2 : 3;
+    constexpr auto base = std::is_signed_v<removed_cv> ? NumberTag::INT8 : NumberTag::UINT8;
+    return static_cast<NumberTag>(static_cast<uint8_t>(base) + width);
+  }
+}
+
+constexpr bool IsSignedTag(NumberTag tag) noexcept { return tag <= NumberTag::INT64; }
+constexpr bool IsUnsignedTag(NumberTag tag) noexcept { return tag >= NumberTag::UINT8 && tag <= NumberTag::BOOLEAN; }
+constexpr bool IsFloatingTag(NumberTag tag) noexcept { return tag >= NumberTag::FLOAT32 && tag <= NumberTag::LONG_DOUBLE; }
+
+}  // namespace internal
+
 class Number {
+  template <ConstOption Opt>
+  friend class NumberReference;
+
  public:
-  Number() noexcept : uint64_(0), descriptor_(&TypeMeta<uint64_t>::GetDescriptor()) { static_assert(std::is_trivially_copyable_v<Number>); }
+  Number() noexcept : uint64_(0), descriptor_(&TypeMeta<uint64_t>::GetDescriptor()), tag_(internal::NumberTag::UINT64) {
+    static_assert(std::is_trivially_copyable_v<Number>);
+  }
 
   template <class Arithmetic, class = std::enable_if_t<std::is_arithmetic_v<Arithmetic>>>
-  Number(Arithmetic v) noexcept : uint64_(0), descriptor_(&TypeMeta<Arithmetic>::GetDescriptor()) {
+  Number(Arithmetic v) noexcept
+      : uint64_(0), descriptor_(&TypeMeta<Arithmetic>::GetDescriptor()), tag_(internal::MakeNumberTag<Arithmetic>()) {
     if constexpr (std::is_floating_point_v<Arithmetic>) {
       float64_ = static_cast<double>(v);
     } else if constexpr (std::is_signed_v<Arithmetic>) {
@@ -26,21 +84,24 @@ class Number {
   template <ConstOption Opt>
   inline Number(const NumberReference<Opt>& ref) noexcept;
 
-  bool IsSignedInteger() const noexcept { return !IsFloating() && descriptor_->Traits(traits::is_signed); }
-  bool IsUnsigned() const noexcept { return descriptor_->Traits(traits::is_unsigned); }
-  bool IsFloating() const noexcept { return descriptor_->Traits(traits::is_floating_point); }
+  bool IsSignedInteger() const noexcept { return internal::IsSignedTag(tag_); }
+  bool IsUnsigned() const noexcept { return internal::IsUnsignedTag(tag_); }
+  bool IsFloating() const noexcept { return internal::IsFloatingTag(tag_); }
 
   void SetInt64(int64_t v) noexcept {
     int64_ = v;
     descriptor_ = &TypeMeta<int64_t>::GetDescriptor();
+    tag_ = internal::NumberTag::INT64;
   }
   void SetUInt64(uint64_t v) noexcept {
     uint64_ = v;
     descriptor_ = &TypeMeta<uint64_t>::GetDescriptor();
+    tag_ = internal::NumberTag::UINT64;
   }
   void SetFloat64(double v) noexcept {
     float64_ = v;
     descriptor_ = &TypeMeta<double>::GetDescriptor();
+    tag_ = internal::NumberTag::FLOAT64;
   }
 
   int64_t AsInt64() const noexcept { return As<int64_t>(); }
@@ -78,71 +139,93 @@ class Number {
     double float64_;
   };
   const TypeDescriptor* descriptor_{};
+  internal::NumberTag tag_;
   static_assert(sizeof(int64_t) == sizeof(uint64_t) && sizeof(uint64_t) == sizeof(double));
 };
 
 namespace internal {
 
-struct NumberInterface {
-  using set_int64_t = void(void*, int64_t) noexcept;
-  using set_uint64_t = void(void*, uint64_t) noexcept;
-  using set_float64_t = void(void*, double) noexcept;
-  using as_int64_t = int64_t(const void*) noexcept;
-  using as_uint64_t = uint64_t(const void*) noexcept;
-  using as_float64_t = double(const void*) noexcept;
-  using descriptor_t = const TypeDescriptor&(const void*) noexcept;
-
-  set_int64_t* set_int64;
-  set_uint64_t* set_uint64;
-  set_float64_t* set_float64;
-  as_int64_t* as_int64;
-  as_uint64_t* as_uint64;
-  as_float64_t* as_float64;
-  descriptor_t* descriptor;
-};
-
-template <class Tp, class Cond = void>
-struct NumberInterfaceImpl {
-  template <class V>
-  static void Set(void* ptr, V v) noexcept {
-    if constexpr (!std::is_const_v<Tp>) {
-      auto number = static_cast<Tp*>(ptr);
-      *number = static_cast<Tp>(v);
-    }
-  }
+// The referenced number is accessed through memcpy, so that the integers of the same width (e.g., long and long long)
+// can share a case without breaking the strict aliasing. The memcpy of a fixed size is compiled into a single load or
+// store.
+template <class Stored>
+Stored LoadAs(const void* ptr) noexcept {
+  Stored v;
+  std::memcpy(&v, ptr, sizeof v);
+  return v;
+}
 
-  template <class V>
-  static V As(const void* ptr) noexcept {
-    auto number = static_cast<const Tp*>(ptr);
-    return static_cast<V>(*number);
-  }
+template <class Stored, class V>
+void StoreAs(void* ptr, V v) noexcept {
+  auto stored = static_cast<Stored>(v);
+  std::memcpy(ptr, &stored, sizeof stored);
+}
 
-  static const TypeDescriptor& Descriptor(const void* ptr) noexcept {
-    if constexpr (IsNumberV<Tp> || IsNumberReferenceV<Tp>) {
-      auto number = static_cast<const Tp*>(ptr);
-      return number->Descriptor();
-    } else {
-      return TypeMeta<Tp>::GetDescriptor();
-    }
+template <class V>
+V LoadNumber(NumberTag tag, const void* ptr) noexcept {
+  switch (tag) {
+    case NumberTag::INT8:
+      return static_cast<V>(LoadAs<int8_t>(ptr));
+    case NumberTag::INT16:
+      return static_cast<V>(LoadAs<int16_t>(ptr));
+    case NumberTag::INT32:
+      return static_cast<V>(LoadAs<int32_t>(ptr));
+    case NumberTag::INT64:
+      return static_cast<V>(LoadAs<int64_t>(ptr));
+    case NumberTag::UINT8:
+      return static_cast<V>(LoadAs<uint8_t>(ptr));
+    case NumberTag::UINT16:
+      return static_cast<V>(LoadAs<uint16_t>(ptr));
+    case NumberTag::UINT32:
+      return static_cast<V>(LoadAs<uint32_t>(ptr));
+    case NumberTag::UINT64:
+      return static_cast<V>(LoadAs<uint64_t>(ptr));
+    case NumberTag::BOOLEAN:
+      return static_cast<V>(LoadAs<bool>(ptr));
+    case NumberTag::FLOAT32:
+      return static_cast<V>(LoadAs<float>(ptr));
+    case NumberTag::FLOAT64:
+      return static_cast<V>(LoadAs<double>(ptr));
+    case NumberTag::LONG_DOUBLE:
+      return static_cast<V>(LoadAs<long double>(ptr));
+    case NumberTag::NUMBER:
+      return static_cast<V>(*static_cast<const Number*>(ptr));
   }
+  return V{};
+}
 
-  static const NumberInterface& MakeNumberInterface() {
-    static_assert(!std::is_reference_v<Tp>);
-    static_assert(std::is_arithmetic_v<Tp> || IsNumberV<Tp> || IsNumberReferenceV<Tp>);
-    static const NumberInterface inter = [&] {
-      NumberInterface interface {};
-      interface.set_int64 = &Set<int64_t>;
-      interface.set_uint64 = &Set<uint64_t>;
-      interface.set_float64 = &Set<double>;
-      interface.as_int64 = &As<int64_t>;
-      interface.as_uint64 = &As<uint64_t>;
-      interface.as_float64 = &As<double>;
-      interface.descriptor = &Descriptor;
-      return interface;
-    }();
-    return inter;
+template <class V>
+void StoreNumber(NumberTag tag, void* ptr, V v) noexcept {
+  switch (tag) {
+    case NumberTag::INT8:
+      return StoreAs<int8_t>(ptr, v);
+    case NumberTag::INT16:
+      return StoreAs<int16_t>(ptr, v);
+    case NumberTag::INT32:
+      return StoreAs<int32_t>(ptr, v);
+    case NumberTag::INT64:
+      return StoreAs<int64_t>(ptr, v);
+    case NumberTag::UINT8:
+      return StoreAs<uint8_t>(ptr, v);
+    case NumberTag::UINT16:
+      return StoreAs<uint16_t>(ptr, v);
+    case NumberTag::UINT32:
+      return StoreAs<uint32_t>(ptr, v);
+    case NumberTag::UINT64:
+      return StoreAs<uint64_t>(ptr, v);
+    case NumberTag::BOOLEAN:
+      return StoreAs<bool>(ptr, v);
+    case NumberTag::FLOAT32:
+      return StoreAs<float>(ptr, v);
+    case NumberTag::FLOAT64:
+      return StoreAs<double>(ptr, v);
+    case NumberTag::LONG_DOUBLE:
+      return StoreAs<long double>(ptr, v);
+    case NumberTag::NUMBER:
+      *static_cast<Number*>(ptr) = Number(v);
+      return;
   }
-};
+}
 
 }  // namespace internal
 
@@ -151,21 +234,22 @@ struct NumberInterfaceImpl {
 template <>
 class NumberReference<ConstOption::NON_CONST> {
   friend class NumberReference<ConstOption::CONST>;
+  friend class Number;
 
  public:
-  NumberReference() noexcept : ptr_(nullptr), interface_(nullptr) {}
+  NumberReference() noexcept : ptr_(nullptr), descriptor_(nullptr), tag_(internal::NumberTag::NUMBER) {}
 
   template <class Tp, std::enable_if_t<std::is_arithmetic_v<Tp> || IsNumberV<Tp>, int> = 0>
-  NumberReference(Tp& v) noexcept : ptr_(&v), interface_(&internal::NumberInterfaceImpl<Tp>::MakeNumberInterface()) {
+  NumberReference(Tp& v) noexcept : ptr_(&v), descriptor_(&TypeMeta<Tp>::GetDescriptor()), tag_(internal::MakeNumberTag<Tp>()) {
     static_assert(std::is_trivially_copyable_v<NumberReference>);
   }
 
-  void SetInt64(int64_t v) noexcept { interface_->set_int64(ptr_, v); }
-  void SetUInt64(uint64_t v) noexcept { interface_->set_uint64(ptr_, v); }
-  void SetFloat64(double v) noexcept { interface_->set_float64(ptr_, v); }
-  int64_t AsInt64() const noexcept { return interface_->as_int64(ptr_); }
-  uint64_t AsUInt64() const noexcept { return interface_->as_uint64(ptr_); }
-  double AsFloat64() const noexcept { return interface_->as_float64(ptr_); }
+  void SetInt64(int64_t v) noexcept { internal::StoreNumber(tag_, ptr_, v); }
+  void SetUInt64(uint64_t v) noexcept { internal::StoreNumber(tag_, ptr_, v); }
+  void SetFloat64(double v) noexcept { internal::StoreNumber(tag_, ptr_, v); }
+  int64_t AsInt64() const noexcept { return internal::LoadNumber<int64_t>(tag_, ptr_); }
+  uint64_t AsUInt64() const noexcept { return internal::LoadNumber<uint64_t>(tag_, ptr_); }
+  double AsFloat64() const noexcept { return internal::LoadNumber<double>(tag_, ptr_); }
 
   bool empty() const noexcept { return ptr_ == nullptr; }
 
@@ -180,33 +264,42 @@ class NumberReference<ConstOption::NON_CONST> {
     }
   }
 
-  const TypeDescriptor& Descriptor() const noexcept { return interface_->descriptor(ptr_); }
-  bool IsSignedInteger() const noexcept { return !IsFloating() && Descriptor().Traits(traits::is_signed); }
-  bool IsUnsigned() const noexcept { return Descriptor().Traits(traits::is_unsigned); }
-  bool IsFloating() const noexcept { return Descriptor().Traits(traits::is_floating_point); }
+  const TypeDescriptor& Descriptor() const noexcept { return IsNumber() ? AsNumber().Descriptor() : *descriptor_; }
+  bool IsSignedInteger() const noexcept { return internal::IsSignedTag(Tag()); }
+  bool IsUnsigned() const noexcept { return internal::IsUnsignedTag(Tag()); }
+  bool IsFloating() const noexcept { return internal::IsFloatingTag(Tag()); }
 
  private:
+  bool IsNumber() const noexcept { return tag_ == internal::NumberTag::NUMBER; }
+  const Number& AsNumber() const noexcept { return *static_cast<const Number*>(ptr_); }
+  internal::NumberTag Tag() const noexcept { return IsNumber() ? AsNumber().tag_ : tag_; }
+
   void* ptr_;
-  const internal::NumberInterface* interface_;
+  const TypeDescriptor* descriptor_;
+  internal::NumberTag tag_;
 };
 
 template <>
 class NumberReference<ConstOption::CONST> {
+  friend class Number;
+
  public:
-  NumberReference() noexcept : ptr_(nullptr), interface_(nullptr) {}
+  NumberReference() noexcept : ptr_(nullptr), descriptor_(nullptr), tag_(internal::NumberTag::NUMBER) {}
 
   template <class Tp, std::enable_if_t<std::is_arithmetic_v<Tp> || IsNumberV<Tp>, int> = 0>
-  NumberReference(const Tp& v) noexcept : ptr_(&v), interface_(&internal::NumberInterfaceImpl<const Tp>::MakeNumberInterface()) {
+  NumberReference(const Tp& v) noexcept
+      : ptr_(&v), descriptor_(&TypeMeta<const Tp>::GetDescriptor()), tag_(internal::MakeNumberTag<Tp>()) {
     static_assert(std::is_trivially_copyable_v<NumberReference>);
   }
 
-  NumberReference(const NumberReference<ConstOption::NON_CONST>& v) noexcept : ptr_(v.ptr_), interface_(v.interface_) {
+  NumberReference(const NumberReference<ConstOption::NON_CONST>& v) noexcept
+      : ptr_(v.ptr_), descriptor_(v.descriptor_), tag_(v.tag_) {
     static_assert(std::is_trivially_copyable_v<NumberReference>);
   }
 
-  int64_t AsInt64() const noexcept { return interface_->as_int64(ptr_); }
-  uint64_t AsUInt64() const noexcept { return interface_->as_uint64(ptr_); }
-  double AsFloat64() const noexcept { return interface_->as_float64(ptr_); }
+  int64_t AsInt64() const noexcept { return internal::LoadNumber<int64_t>(tag_, ptr_); }
+  uint64_t AsUInt64() const noexcept { return internal::LoadNumber<uint64_t>(tag_, ptr_); }
+  double AsFloat64() const noexcept { return internal::LoadNumber<double>(tag_, ptr_); }
 
   bool empty() const noexcept { return ptr_ == nullptr; }
 
@@ -221,21 +314,28 @@ class NumberReference<ConstOption::CONST> {
     }
   }
 
-  const TypeDescriptor& Descriptor() const noexcept { return interface_->descriptor(ptr_); }
-  bool IsSignedInteger() const noexcept { return !IsFloating() && Descriptor().Traits(traits::is_signed); }
-  bool IsUnsigned() const noexcept { return Descriptor().Traits(traits::is_unsigned); }
-  bool IsFloating() const noexcept { return Descriptor().Traits(traits::is_floating_point); }
+  const TypeDescriptor& Descriptor() const noexcept { return IsNumber() ? AsNumber().Descriptor() : *descriptor_; }
+  bool IsSignedInteger() const noexcept { return internal::IsSignedTag(Tag()); }
+  bool IsUnsigned() const noexcept { return internal::IsUnsignedTag(Tag()); }
+  bool IsFloating() const noexcept { return internal::IsFloatingTag(Tag()); }
 
  private:
+  bool IsNumber() const noexcept { return tag_ == internal::NumberTag::NUMBER; }
+  const Number& AsNumber() const noexcept { return *static_cast<const Number*>(ptr_); }
+  internal::NumberTag Tag() const noexcept { return IsNumber() ? AsNumber().tag_ : tag_; }
+
   const void* ptr_;
-  const internal::NumberInterface* interface_;
+  const TypeDescriptor* descriptor_;
+  internal::NumberTag tag_;
 };
 
 template <ConstOption Opt>
-inline Number::Number(const NumberReference<Opt>& ref) noexcept : uint64_(0), descriptor_(ref.Descriptor()) {
-  if (ref.IsSignedInteger()) {
+inline Number::Number(const NumberReference<Opt>& ref) noexcept : uint64_(0), descriptor_(ref.descriptor_), tag_(ref.tag_) {
+  if (ref.IsNumber()) {
+    *this = ref.AsNumber();
+  } else if (internal::IsSignedTag(tag_)) {
     int64_ = ref.AsInt64();
-  } else if (ref.IsUnsigned()) {
+  } else if (internal::IsUnsignedTag(tag_)) {
     uint64_ = ref.AsUInt64();
   } else {
     float64_ = ref.AsFloat64();
@@ -248,4 +348,4 @@ NumberReference(Tp&& v) -> NumberReference<ConstOption::CONST>;
 template <class Tp, std::enable_if_t<!std::is_const_v<std::remove_reference_t<Tp>>, int> = 0>
 NumberReference(Tp&& v) -> NumberReference<ConstOption::NON_CONST>;
 
-}  // namespace liteproto
\ No newline at end of file
+}  // namespace liteproto
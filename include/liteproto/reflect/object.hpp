@@ -4,7 +4,6 @@
 
 #pragma once
 
-#include <any>
 #include <cstring>
 #include <optional>
 #include <sstream>
@@ -46,10 +45,40 @@ std::optional<String<Opt>> StringCast(const Object& object) noexcept;
 template <class First, class Second>
 std::optional<Pair<First, Second>> PairCast(const Object& object) noexcept;
 
+template <class K, class V, ConstOption Opt = ConstOption::NON_CONST>
+std::optional<Map<K, V, Opt>> MapCast(const Object& object) noexcept;
+
+namespace internal {
+
+template <ConstOption Opt>
+using MessagePointer = std::conditional_t<Opt == ConstOption::CONST, const Message*, Message*>;
+
+}  // namespace internal
+
+template <ConstOption Opt = ConstOption::NON_CONST>
+internal::MessagePointer<Opt> MessageCast(const Object& object) noexcept;
+
+namespace internal {
+
+// ObjectInterface makes the interface of an object (e.g., the List of a std::vector) from its address. There is a
+// single static instance for each type, so an Object only keeps a pointer to it, and the interface is only made when
+// the Object is cast. The result points to a std::optional of the interface type, which is identified by proxy_id.
+struct ObjectInterface {
+  const void* proxy_id;
+  void (*make_proxy)(const void* addr, void* result) noexcept;
+};
+
+}  // namespace internal
+
+// Object is a handle of a value, which consists of the address, the type descriptor and the interface of the value.
+// It's trivially copyable and never allocates. The casts compare the type ID of the target with the one of the Object.
 class Object {
   template <class Tp>
   friend Object GetReflection(Tp* v) noexcept;
 
+  template <class Tp>
+  friend Tp* ObjectCast(const Object& object) noexcept;
+
   template <ConstOption Opt>
   friend std::optional<NumberReference<Opt>> NumberCast(const Object& object) noexcept;
 
@@ -62,6 +91,12 @@ class Object {
   template <class First, class Second>
   friend std::optional<Pair<First, Second>> PairCast(const Object& object) noexcept;
 
+  template <class K, class V, ConstOption Opt>
+  friend std::optional<Map<K, V, Opt>> MapCast(const Object& object) noexcept;
+
+  template <ConstOption Opt>
+  friend internal::MessagePointer<Opt> MessageCast(const Object& object) noexcept;
+
  public:
   [[nodiscard]] addr_t Addr() const noexcept {
     addr_t addr = 0;
@@ -78,60 +113,50 @@ class Object {
     return str;
   }
 
-  [[nodiscard]] const std::any& Value() const noexcept { return ptr_to_value_; }
   [[nodiscard]] bool empty() const noexcept { return addr_ == nullptr; }
   [[nodiscard]] const TypeDescriptor& Descriptor() const noexcept { return *descriptor_; }
 
-  Object() noexcept : descriptor_(), addr_(nullptr) {}
-  Object(const Object&) = default;
-  Object(Object&& rhs) noexcept
-      : descriptor_(rhs.descriptor_), ptr_to_value_(std::move(rhs.ptr_to_value_)), interface_(std::move(rhs.interface_)), addr_(rhs.addr_) {
-    rhs.addr_ = nullptr;
-  }
-  Object& operator=(const Object&) = default;
-  Object& operator=(Object&& rhs) noexcept {
-    descriptor_ = rhs.descriptor_;
-    ptr_to_value_ = std::move(rhs.ptr_to_value_);
-    interface_ = std::move(rhs.interface_);
-    addr_ = rhs.addr_;
-    rhs.addr_ = nullptr;
-    return *this;
-  }
+  Object() noexcept : descriptor_(), interface_(nullptr), addr_(nullptr) {}
 
  private:
-  template <class Tp, class Interface>
-  Object(Tp* value_ptr, Interface interface) noexcept
-      : descriptor_(&TypeMeta<Tp>::GetDescriptor()), ptr_to_value_(value_ptr), interface_(std::move(interface)), addr_(value_ptr) {}
+  template <class Tp>
+  Object(Tp* value_ptr, const internal::ObjectInterface* interface) noexcept
+      : descriptor_(&TypeMeta<Tp>::GetDescriptor()), interface_(interface), addr_(value_ptr) {}
 
   template <class Tp /*, class = std::enable_if_t<std::is_scalar_v<Tp>>*/>
-  explicit Object(Tp* value_ptr) noexcept : descriptor_(&TypeMeta<Tp>::GetDescriptor()), ptr_to_value_(value_ptr), addr_(value_ptr) {}
+  explicit Object(Tp* value_ptr) noexcept : descriptor_(&TypeMeta<Tp>::GetDescriptor()), interface_(nullptr), addr_(value_ptr) {}
+
+  template <class Proxy>
+  [[nodiscard]] std::optional<Proxy> ProxyCast() const noexcept {
+    std::optional<Proxy> result;
+    if (interface_ != nullptr && interface_->proxy_id == &internal::kTypeId<Proxy>) {
+      interface_->make_proxy(addr_, &result);
+    }
+    return result;
+  }
 
   const TypeDescriptor* descriptor_;
-  std::any ptr_to_value_;
-  std::any interface_;
+  const internal::ObjectInterface* interface_;
   const void* addr_;
 };
 
+static_assert(std::is_trivially_copyable_v<Object>);
+
 template <class Tp>
 [[nodiscard]] Object GetReflection(Tp* v) noexcept;
 
+// The descriptor of Tp is unique, so it's also the ID of the type.
 template <class Tp>
 Tp* ObjectCast(const Object& object) noexcept {
-  auto indirect_ptr = std::any_cast<Tp*>(&object.Value());
-  if (indirect_ptr == nullptr) {
+  if (object.descriptor_ != &TypeMeta<Tp>::GetDescriptor()) {
     return nullptr;
   }
-  return *indirect_ptr;
+  return static_cast<Tp*>(const_cast<void*>(object.addr_));
 }
 
 template <ConstOption Opt>
 std::optional<NumberReference<Opt>> NumberCast(const Object& object) noexcept {
-  using return_type = std::optional<NumberReference<Opt>>;
-  auto indirect_ptr = std::any_cast<NumberReference<Opt>>(&object.interface_);
-  if (indirect_ptr == nullptr) {
-    return return_type{};
-  }
-  return return_type{*indirect_ptr};
+  return object.ProxyCast<NumberReference<Opt>>();
 }
 
 }  // namespace liteproto
\ No newline at end of file
@@ -4,8 +4,10 @@
 
 #pragma once
 
+#include <any>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <type_traits>
 #include <typeinfo>
 #include <utility>
@@ -22,8 +24,9 @@ namespace liteproto {
 // Thees are six abstract interfaces that supported by liteproto: Number, Message, List, Map, String, Array.
 
 // A List is a flexible-sized sequential container_type. The elements can be accessed by subscript operator (i.e.,
-// operator[]), but no random accessible required. A List also supports push_back and pop_back, and inserts a
-// new element to arbitrary position.
+// operator[]), but no random accessible required, so the subscript is linear for a container like std::list. Use the
+// ListCursor (List::cursor()) to index such a list in a loop. A List also supports push_back and pop_back, and inserts
+// a new element to arbitrary position.
 // A List also supports size(), empty(), and clear().
 
 // A Map is an key-value pairs collection. Each key must be unique in a map, and the value can be looked up via the
@@ -199,89 +202,140 @@ class TypeDescriptor;
 
 namespace internal {
 
-struct DescriptorInterface {
-  using id_t = uint64_t() noexcept;
-  using kinde_enum_t = Kind() noexcept;
-  using type_enum_t = Type() noexcept;
-  using traits_t = bool(traits) noexcept;
-  using transform_t = const TypeDescriptor&(transform) noexcept;
-  using size_of_t = size_t() noexcept;
-  using alignment_of_t = size_t() noexcept;
-  using rank_t = size_t() noexcept;
-  using extent_t = size_t() noexcept;
-
-  using value_type_t = const TypeDescriptor&() noexcept;
-  using first_type_t = const TypeDescriptor&() noexcept;
-  using second_type_t = const TypeDescriptor&() noexcept;
-
-  using is_indirect_type_t = bool() noexcept;
-  using default_value = std::pair<Object, std::any>() noexcept;
-
-  id_t* id_;
-  kinde_enum_t* kind_enum_;
-  type_enum_t* type_enum_;
-  traits_t* traits_;
-  transform_t* transform_;
-  size_of_t* size_of_;
-  alignment_of_t* alignment_of_;
-  rank_t* rank_;
-  extent_t* extent_;
-
-  value_type_t* value_type_;
-  first_type_t* first_type_;
-  second_type_t* second_type_;
+// The address of kTypeId<Tp> identifies the type Tp without RTTI.
+template <class Tp>
+inline constexpr char kTypeId = 0;
 
-  is_indirect_type_t* is_indirect_type_;
-  default_value* default_value_;
+template <class Tp>
+struct TypeTag {
+  using type = Tp;
 };
 
+template <class Tp>
+constexpr TypeDescriptor MakeTypeDescriptor() noexcept;
+
+template <class Tp>
+constexpr auto ValueTypeTag(TypeTag<Tp>) noexcept {
+  if constexpr (std::is_pointer_v<Tp>) {
+    return TypeTag<std::remove_pointer_t<Tp>>{};
+  } else if constexpr (std::is_reference_v<Tp>) {
+    return TypeTag<std::remove_reference_t<Tp>>{};
+  } else if constexpr (std::is_array_v<Tp>) {
+    return TypeTag<std::remove_extent_t<Tp>>{};
+  } else if constexpr (IsSmartPtrV<Tp>) {
+    return TypeTag<typename SmartPtrTraits<Tp>::value_type>{};
+  } else if constexpr (IsListV<Tp>) {
+    return TypeTag<typename ListTraits<Tp>::value_type>{};
+  } else if constexpr (IsArrayV<Tp>) {
+    return TypeTag<typename ArrayTraits<Tp>::value_type>{};
+  } else if constexpr (IsMapV<Tp>) {
+    return TypeTag<typename MapTraits<Tp>::value_type>{};
+  } else if constexpr (IsPairV<Tp>) {
+    return TypeTag<typename PairTraits<Tp>::value_type>{};
+  } else {
+    return TypeTag<void>{};
+  }
+}
+
+template <class Tp>
+constexpr auto FirstTypeTag(TypeTag<Tp>) noexcept {
+  if constexpr (IsPairV<Tp>) {
+    return TypeTag<typename PairTraits<Tp>::first_type>{};
+  } else {
+    return TypeTag<void>{};
+  }
+}
+
+template <class Tp>
+constexpr auto SecondTypeTag(TypeTag<Tp>) noexcept {
+  if constexpr (IsPairV<Tp>) {
+    return TypeTag<typename PairTraits<Tp>::second_type>{};
+  } else {
+    return TypeTag<void>{};
+  }
+}
+
+// The types which are described by TypeDescriptor::ValueType(), FirstType() and SecondType().
+template <class Tp>
+using ValueTypeOf = typename decltype(ValueTypeTag(TypeTag<Tp>{}))::type;
+template <class Tp>
+using FirstTypeOf = typename decltype(FirstTypeTag(TypeTag<Tp>{}))::type;
+template <class Tp>
+using SecondTypeOf = typename decltype(SecondTypeTag(TypeTag<Tp>{}))::type;
+
 }  // namespace internal
 
+// TypeDescriptor is a constexpr record of a type, there is a single instance for each type (see
+// TypeMeta::GetDescriptor). All the properties are computed at compile time, so a query is a plain load rather than an
+// indirect call. Only the transforms and the default value, which are rarely used, are still looked up through function
+// pointers.
 class TypeDescriptor {
   template <class Tp>
   friend struct TypeMeta;
 
+  template <class Tp>
+  friend constexpr TypeDescriptor internal::MakeTypeDescriptor() noexcept;
+
   friend class Object;
 
+  using transform_t = const TypeDescriptor&(transform) noexcept;
+  using default_value_t = std::pair<Object, std::any>() noexcept;
+
  public:
-  [[nodiscard]] uint64_t Id() const noexcept { return inter_.id_(); }
-  [[nodiscard]] Kind KindEnum() const noexcept { return inter_.kind_enum_(); }
-  [[nodiscard]] Type TypeEnum() const noexcept { return inter_.type_enum_(); }
-  [[nodiscard]] bool Traits(traits t) const noexcept { return inter_.traits_(t); }
-  [[nodiscard]] const TypeDescriptor& Transform(transform t) const noexcept { return inter_.transform_(t); }
+  [[nodiscard]] uint64_t Id() const noexcept {
+    uint64_t id = 0;
+    std::memcpy(&id, &id_, sizeof id_);
+    return id;
+  }
+  [[nodiscard]] constexpr Kind KindEnum() const noexcept { return kind_; }
+  [[nodiscard]] constexpr Type TypeEnum() const noexcept { return type_; }
+  [[nodiscard]] constexpr bool Traits(traits t) const noexcept { return (traits_ >> static_cast<uint8_t>(t)) & 1; }
+  [[nodiscard]] const TypeDescriptor& Transform(transform t) const noexcept { return transform_(t); }
 
-  [[nodiscard]] bool IsIndirectType() const noexcept { return inter_.is_indirect_type_(); }
+  [[nodiscard]] constexpr bool IsIndirectType() const noexcept { return is_indirect_type_; }
   [[nodiscard]] inline std::pair<Object, std::any> DefaultValue() const noexcept;
 
-  [[nodiscard]] size_t SizeOf() const noexcept { return inter_.size_of_(); }
-  [[nodiscard]] size_t AlignmentOf() const noexcept { return inter_.alignment_of_(); }
-  [[nodiscard]] size_t Rank() const noexcept { return inter_.rank_(); }
-  [[nodiscard]] size_t Extent() const noexcept { return inter_.extent_(); }
+  [[nodiscard]] constexpr size_t SizeOf() const noexcept { return size_of_; }
+  [[nodiscard]] constexpr size_t AlignmentOf() const noexcept { return alignment_of_; }
+  [[nodiscard]] constexpr size_t Rank() const noexcept { return rank_; }
+  [[nodiscard]] constexpr size_t Extent() const noexcept { return extent_; }
 
-  [[nodiscard]] const TypeDescriptor& ValueType() const noexcept { return inter_.value_type_(); }
-  [[nodiscard]] const TypeDescriptor& FirstType() const noexcept { return inter_.first_type_(); }
-  [[nodiscard]] const TypeDescriptor& SecondType() const noexcept { return inter_.second_type_(); }
+  [[nodiscard]] constexpr const TypeDescriptor& ValueType() const noexcept { return *value_type_; }
+  [[nodiscard]] constexpr const TypeDescriptor& FirstType() const noexcept { return *first_type_; }
+  [[nodiscard]] constexpr const TypeDescriptor& SecondType() const noexcept { return *second_type_; }
 
-  bool operator==(const TypeDescriptor& rhs) const { return Id() == rhs.Id(); }
-  bool operator!=(const TypeDescriptor& rhs) const { return Id() != rhs.Id(); }
+  bool operator==(const TypeDescriptor& rhs) const { return id_ == rhs.id_; }
+  bool operator!=(const TypeDescriptor& rhs) const { return id_ != rhs.id_; }
 
  private:
-  TypeDescriptor() = default;
-
-  explicit constexpr TypeDescriptor(const internal::DescriptorInterface& inter) : inter_(inter) {}
-  internal::DescriptorInterface inter_;
+  template <class Tp>
+  explicit constexpr TypeDescriptor(internal::TypeTag<Tp>) noexcept;
+
+  const void* id_;
+  Kind kind_;
+  Type type_;
+  bool is_indirect_type_;
+  uint64_t traits_;
+  size_t size_of_;
+  size_t alignment_of_;
+  size_t rank_;
+  size_t extent_;
+  const TypeDescriptor* value_type_;
+  const TypeDescriptor* first_type_;
+  const TypeDescriptor* second_type_;
+  transform_t* transform_;
+  default_value_t* default_value_;
 };
 
 template <class Tp>
 struct TypeMeta {
-  static inline const TypeDescriptor& GetDescriptor() noexcept;
+  static constexpr const TypeDescriptor& GetDescriptor() noexcept;
   static inline std::pair<Object, std::any> DefaultValue() noexcept;
 
   static constexpr bool IsIndirectType() noexcept { return IsIndirectTypeV<Tp>; }
 
   static uint64_t Id() noexcept {
-    static uint64_t alloc_addr = 0;
-    auto addr_val = &alloc_addr;
+    auto addr_val = &internal::kTypeId<Tp>;
     uint64_t id = 0;
     std::memcpy(&id, &addr_val, sizeof addr_val);
     return id;
@@ -362,49 +416,9 @@ struct TypeMeta {
     }
   }
 
-  static constexpr const TypeDescriptor& ValueType() noexcept {
-    if constexpr (std::is_pointer_v<Tp>) {
-      return remove_pointer();
-    } else if constexpr (std::is_reference_v<Tp>) {
-      return remove_reference();
-    } else if constexpr (std::is_array_v<Tp>) {
-      return remove_extent();
-    } else if constexpr (IsSmartPtrV<Tp>) {
-      return TypeMeta<typename SmartPtrTraits<Tp>::value_type>::GetDescriptor();
-    } else if constexpr (IsListV<Tp>) {
-      using traits = ListTraits<Tp>;
-      return TypeMeta<typename traits::value_type>::GetDescriptor();
-    } else if constexpr (IsArrayV<Tp>) {
-      using traits = ArrayTraits<Tp>;
-      return TypeMeta<typename traits::value_type>::GetDescriptor();
-    } else if constexpr (IsMapV<Tp>) {
-      using traits = MapTraits<Tp>;
-      return TypeMeta<typename traits::value_type>::GetDescriptor();
-    } else if constexpr (IsPairV<Tp>) {
-      using traits = PairTraits<Tp>;
-      return TypeMeta<typename traits::value_type>::GetDescriptor();
-    }
-
-    return TypeMeta<void>::GetDescriptor();
-  }
-
-  static constexpr const TypeDescriptor& FirstType() noexcept {
-    if constexpr (IsPairV<Tp>) {
-      using traits = PairTraits<Tp>;
-      return TypeMeta<typename traits::first_type>::GetDescriptor();
-    }
-
-    return TypeMeta<void>::GetDescriptor();
-  }
-
-  static constexpr const TypeDescriptor& SecondType() noexcept {
-    if constexpr (IsPairV<Tp>) {
-      using traits = PairTraits<Tp>;
-      return TypeMeta<typename traits::second_type>::GetDescriptor();
-    }
-
-    return TypeMeta<void>::GetDescriptor();
-  }
+  static constexpr const TypeDescriptor& ValueType() noexcept { return TypeMeta<internal::ValueTypeOf<Tp>>::GetDescriptor(); }
+  static constexpr const TypeDescriptor& FirstType() noexcept { return TypeMeta<internal::FirstTypeOf<Tp>>::GetDescriptor(); }
+  static constexpr const TypeDescriptor& SecondType() noexcept { return TypeMeta<internal::SecondTypeOf<Tp>>::GetDescriptor(); }
 
   static constexpr Kind KindEnum() noexcept {
     if constexpr (IsObjectV<Tp>) {
@@ -431,6 +445,10 @@ struct TypeMeta {
       return Kind::ARRAY;
     } else if constexpr (IsPairV<Tp>) {
       return Kind::PAIR;
+    } else if constexpr (IsMessageV<Tp>) {
+      return Kind::MESSAGE;
+    } else if constexpr (IsMapV<Tp>) {
+      return Kind::MAP;
     } else if constexpr (std::is_class_v<Tp>) {
       return Kind::CLASS;
     } else {
@@ -566,8 +584,53 @@ struct TypeMeta {
     }
     return true;
   }
+
+  // The traits of Tp as a bitmask indexed by traits.
+  static constexpr uint64_t TraitsMask() noexcept {
+    uint64_t mask = 0;
+    for (uint8_t t = 0; t <= static_cast<uint8_t>(traits::has_unique_object_representations); ++t) {
+      mask |= static_cast<uint64_t>(Traits(static_cast<traits>(t))) << t;
+    }
+    return mask;
+  }
 };
 
+static_assert(static_cast<uint8_t>(traits::has_unique_object_representations) < 64);
+
+namespace internal {
+
+template <class Tp>
+constexpr TypeDescriptor MakeTypeDescriptor() noexcept {
+  return TypeDescriptor{TypeTag<Tp>{}};
+}
+
+template <class Tp>
+inline constexpr TypeDescriptor kTypeDescriptor = MakeTypeDescriptor<Tp>();
+
+}  // namespace internal
+
+template <class Tp>
+constexpr TypeDescriptor::TypeDescriptor(internal::TypeTag<Tp>) noexcept
+    : id_(&internal::kTypeId<Tp>),
+      kind_(TypeMeta<Tp>::KindEnum()),
+      type_(TypeMeta<Tp>::TypeEnum()),
+      is_indirect_type_(TypeMeta<Tp>::IsIndirectType()),
+      traits_(TypeMeta<Tp>::TraitsMask()),
+      size_of_(TypeMeta<Tp>::SizeOf()),
+      alignment_of_(TypeMeta<Tp>::AlignmentOf()),
+      rank_(TypeMeta<Tp>::Rank()),
+      extent_(TypeMeta<Tp>::Extent()),
+      value_type_(&internal::kTypeDescriptor<internal::ValueTypeOf<Tp>>),
+      first_type_(&internal::kTypeDescriptor<internal::FirstTypeOf<Tp>>),
+      second_type_(&internal::kTypeDescriptor<internal::SecondTypeOf<Tp>>),
+      transform_(&TypeMeta<Tp>::Transform),
+      default_value_(&TypeMeta<Tp>::DefaultValue) {}
+
+template <class Tp>
+constexpr const TypeDescriptor& TypeMeta<Tp>::GetDescriptor() noexcept {
+  return internal::kTypeDescriptor<Tp>;
+}
+
 inline const TypeDescriptor void_descriptor = TypeMeta<void>::GetDescriptor();
 
 }  // namespace liteproto
\ No newline at end of file
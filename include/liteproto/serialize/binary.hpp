@@ -0,0 +1,547 @@
+#pragma once
+
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "liteproto/serialize/packed.hpp"
+#include "liteproto/serialize/wire_format.hpp"
+#include "liteproto/traits/traits.hpp"
+
+namespace liteproto {
+
+namespace internal {
+
+// ValueCodec encodes a single value, without the tag. The Size() of a length-delimited value includes its length prefix.
+// Size<true>() takes the sizes of the embedded messages from their cache rather than computing them again, which is
+// what Write() relies on, so Write() must follow a Size<false>() of the same value (see MessageBase::ByteSize()).
+// FieldCodec encodes a whole field, i.e., zero or more records which all start with the tag of the field.
+// The Read() functions decode the value or the record at the given position, and return the position next to it, or
+// nullptr if the input is malformed. A FieldCodec skips the record whose wire type doesn't match the field.
+//
+// The types are mapped to the protobuf wire format as below.
+// bool, integers and enums: varint (int32 and int64 semantic, negative values always take 10 bytes).
+// float: fixed32, double: fixed64.
+// String: length-delimited bytes.
+// Message: length-delimited embedded message.
+// List: repeated field, each element is a record. If the elements are numbers, the list is packed into a single
+// length-delimited record like protobuf, the parser accepts both the packed and the unpacked records.
+// Map: repeated field, each entry is an embedded message {1: key, 2: value}, which is the same as the protobuf map.
+// Pair: embedded message {1: first, 2: second}.
+// A List or Map that is nested in another container cannot be a repeated field by itself, so it is wrapped into an
+// embedded message with the only field {1: the list or the map}.
+// std::string_view: the same as String, but it is decoded by pointing into the input buffer rather than copying, so the
+// input must outlive the message.
+
+template <class Tp, class = void>
+struct ValueCodec {
+  static_assert(!std::is_same_v<Tp, Tp>, "this type cannot be serialized");
+};
+
+template <class Tp, class = void>
+struct FieldCodec;
+
+template <class Tp, class = void>
+struct RepeatedValueType {
+  using type = typename ListTraits<Tp>::value_type;
+};
+
+template <class Tp>
+struct RepeatedValueType<Tp, std::enable_if_t<IsMapV<Tp>>> {
+  using type = typename MapTraits<Tp>::value_type;
+};
+
+template <class Tp, class = void>
+struct IsPackedList : std::false_type {};
+
+template <class Tp>
+struct IsPackedList<Tp, std::enable_if_t<!IsStringV<Tp> && !IsMessageV<Tp> && IsListV<Tp>>>
+    : std::bool_constant<std::is_arithmetic_v<typename ListTraits<Tp>::value_type> ||
+                         std::is_enum_v<typename ListTraits<Tp>::value_type>> {};
+
+template <class Tp>
+inline constexpr bool IsPackedListV = IsPackedList<Tp>::value;
+
+// The elements of a contiguous list can be encoded and decoded in bulk.
+template <class Tp>
+inline constexpr bool IsContiguousListV = has_data_v<Tp, typename ListTraits<Tp>::value_type> &&
+                                          !std::is_same_v<typename ListTraits<Tp>::value_type, bool>;
+
+template <class Tp>
+struct ValueCodec<Tp, std::enable_if_t<std::is_integral_v<Tp> || std::is_enum_v<Tp>>> {
+  static constexpr WireType wire_type = WireType::VARINT;
+
+  static constexpr uint64_t ToWire(Tp v) noexcept {
+    if constexpr (std::is_enum_v<Tp>) {
+      return ValueCodec<std::underlying_type_t<Tp>>::ToWire(static_cast<std::underlying_type_t<Tp>>(v));
+    } else if constexpr (std::is_signed_v<Tp>) {
+      return static_cast<uint64_t>(static_cast<int64_t>(v));
+    } else {
+      return static_cast<uint64_t>(v);
+    }
+  }
+
+  static constexpr Tp FromWire(uint64_t v) noexcept {
+    if constexpr (std::is_same_v<Tp, bool>) {
+      return v != 0;
+    } else {
+      return static_cast<Tp>(v);
+    }
+  }
+
+  static bool IsDefault(const Tp& v) noexcept { return v == Tp{}; }
+  template <bool Cached = false>
+  static size_t Size(const Tp& v) noexcept {
+    return VarintSize(ToWire(v));
+  }
+  static char* Write(const Tp& v, char* p) noexcept { return WriteVarint(ToWire(v), p); }
+
+  static const char* Read(const char* p, const char* end, Tp* v) noexcept {
+    uint64_t wire = 0;
+    p = ReadVarint(p, end, &wire);
+    if (p != nullptr) {
+      *v = FromWire(wire);
+    }
+    return p;
+  }
+  static void Clear(Tp* v) noexcept { *v = Tp{}; }
+};
+
+template <class Tp>
+struct ValueCodec<Tp, std::enable_if_t<std::is_floating_point_v<Tp>>> {
+  static_assert(sizeof(Tp) == 4 || sizeof(Tp) == 8, "only float and double can be serialized");
+  static constexpr WireType wire_type = sizeof(Tp) == 4 ? WireType::FIXED32 : WireType::FIXED64;
+  using bits_type = std::conditional_t<sizeof(Tp) == 4, uint32_t, uint64_t>;
+
+  static bits_type ToWire(Tp v) noexcept {
+    bits_type bits;
+    std::memcpy(&bits, &v, sizeof bits);
+    return bits;
+  }
+
+  // -0.0 is not the default value.
+  static bool IsDefault(const Tp& v) noexcept { return ToWire(v) == 0; }
+  template <bool Cached = false>
+  static constexpr size_t Size(const Tp&) noexcept {
+    return sizeof(Tp);
+  }
+  static char* Write(const Tp& v, char* p) noexcept {
+    if constexpr (sizeof(Tp) == 4) {
+      return WriteFixed32(ToWire(v), p);
+    } else {
+      return WriteFixed64(ToWire(v), p);
+    }
+  }
+
+  static const char* Read(const char* p, const char* end, Tp* v) noexcept {
+    bits_type bits = 0;
+    if constexpr (sizeof(Tp) == 4) {
+      p = ReadFixed32(p, end, &bits);
+    } else {
+      p = ReadFixed64(p, end, &bits);
+    }
+    if (p != nullptr) {
+      std::memcpy(v, &bits, sizeof bits);
+    }
+    return p;
+  }
+  static void Clear(Tp* v) noexcept { *v = Tp{}; }
+};
+
+template <class Tp>
+struct ValueCodec<Tp, std::enable_if_t<IsStringV<Tp>>> {
+  static constexpr WireType wire_type = WireType::LENGTH_DELIMITED;
+
+  static bool IsDefault(const Tp& v) noexcept { return v.empty(); }
+  template <bool Cached = false>
+  static size_t Size(const Tp& v) noexcept {
+    return LengthDelimitedSize(v.size());
+  }
+  static char* Write(const Tp& v, char* p) noexcept {
+    p = WriteVarint(v.size(), p);
+    return WriteBytes(v.data(), v.size() * sizeof(*v.data()), p);
+  }
+
+  // assign() reuses the capacity of the string.
+  static const char* Read(const char* p, const char* end, Tp* v) {
+    size_t len = 0;
+    p = ReadLength(p, end, &len);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    v->assign(p, len);
+    return p + len;
+  }
+  static void Clear(Tp* v) noexcept { v->clear(); }
+};
+
+template <>
+struct ValueCodec<std::string_view> {
+  static constexpr WireType wire_type = WireType::LENGTH_DELIMITED;
+
+  static bool IsDefault(std::string_view v) noexcept { return v.empty(); }
+  template <bool Cached = false>
+  static size_t Size(std::string_view v) noexcept {
+    return LengthDelimitedSize(v.size());
+  }
+  static char* Write(std::string_view v, char* p) noexcept {
+    p = WriteVarint(v.size(), p);
+    return WriteBytes(v.data(), v.size(), p);
+  }
+
+  static const char* Read(const char* p, const char* end, std::string_view* v) noexcept {
+    size_t len = 0;
+    p = ReadLength(p, end, &len);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    *v = std::string_view{p, len};
+    return p + len;
+  }
+  static void Clear(std::string_view* v) noexcept { *v = std::string_view{}; }
+};
+
+template <class Tp>
+struct ValueCodec<Tp, std::enable_if_t<IsMessageV<Tp>>> {
+  static constexpr WireType wire_type = WireType::LENGTH_DELIMITED;
+
+  // An embedded message is always present.
+  static constexpr bool IsDefault(const Tp&) noexcept { return false; }
+  template <bool Cached = false>
+  static size_t Size(const Tp& v) noexcept {
+    return LengthDelimitedSize(Cached ? v.GetCachedSize() : v.ByteSize());
+  }
+  static char* Write(const Tp& v, char* p) noexcept {
+    p = WriteVarint(v.GetCachedSize(), p);
+    return v.InternalSerialize(p);
+  }
+
+  // Like protobuf, an embedded message that appears more than once is merged.
+  static const char* Read(const char* p, const char* end, Tp* v) {
+    size_t len = 0;
+    p = ReadLength(p, end, &len);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    return v->InternalMerge(p, p + len);
+  }
+  static void Clear(Tp* v) { v->InternalClear(); }
+};
+
+// Read an embedded message {1: first, 2: second} of which the length prefix has been consumed.
+template <class First, class Second>
+const char* ReadEntry(const char* p, const char* end, First* first, Second* second) {
+  while (p < end) {
+    int32_t seq;
+    WireType type;
+    p = ReadTag(p, end, &seq, &type);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    if (seq == 1) {
+      p = FieldCodec<First>::Read(type, p, end, first);
+    } else if (seq == 2) {
+      p = FieldCodec<Second>::Read(type, p, end, second);
+    } else {
+      p = SkipField(type, p, end);
+    }
+    if (p == nullptr) {
+      return nullptr;
+    }
+  }
+  return p;
+}
+
+template <class Tp>
+struct ValueCodec<Tp, std::enable_if_t<!IsMessageV<Tp> && IsPairV<Tp>>> {
+  static constexpr WireType wire_type = WireType::LENGTH_DELIMITED;
+  using first_codec = FieldCodec<std::remove_cv_t<typename PairTraits<Tp>::first_type>>;
+  using second_codec = FieldCodec<std::remove_cv_t<typename PairTraits<Tp>::second_type>>;
+
+  template <bool Cached>
+  static size_t PayloadSize(const Tp& v) noexcept {
+    return first_codec::template Size<Cached>(1, v.first) + second_codec::template Size<Cached>(2, v.second);
+  }
+
+  static constexpr bool IsDefault(const Tp&) noexcept { return false; }
+  template <bool Cached = false>
+  static size_t Size(const Tp& v) noexcept {
+    return LengthDelimitedSize(PayloadSize<Cached>(v));
+  }
+  static char* Write(const Tp& v, char* p) noexcept {
+    p = WriteVarint(PayloadSize<true>(v), p);
+    p = first_codec::Write(1, v.first, p);
+    return second_codec::Write(2, v.second, p);
+  }
+
+  static const char* Read(const char* p, const char* end, Tp* v) {
+    size_t len = 0;
+    p = ReadLength(p, end, &len);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    return ReadEntry(p, p + len, &v->first, &v->second);
+  }
+  static void Clear(Tp* v) {
+    first_codec::Clear(&v->first);
+    second_codec::Clear(&v->second);
+  }
+};
+
+// A List or Map as a value (rather than a field) is wrapped into an embedded message.
+template <class Tp>
+struct ValueCodec<Tp, std::enable_if_t<!IsStringV<Tp> && !IsMessageV<Tp> && (IsListV<Tp> || IsMapV<Tp>)>> {
+  static constexpr WireType wire_type = WireType::LENGTH_DELIMITED;
+  using wrapped_codec = FieldCodec<std::remove_cv_t<Tp>>;
+
+  static constexpr bool IsDefault(const Tp&) noexcept { return false; }
+  template <bool Cached = false>
+  static size_t Size(const Tp& v) noexcept {
+    return LengthDelimitedSize(wrapped_codec::template Size<Cached>(1, v));
+  }
+  static char* Write(const Tp& v, char* p) noexcept {
+    p = WriteVarint(wrapped_codec::template Size<true>(1, v), p);
+    return wrapped_codec::Write(1, v, p);
+  }
+
+  static const char* Read(const char* p, const char* end, Tp* v) {
+    size_t len = 0;
+    p = ReadLength(p, end, &len);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    const char* payload_end = p + len;
+    while (p < payload_end) {
+      int32_t seq;
+      WireType type;
+      p = ReadTag(p, payload_end, &seq, &type);
+      if (p == nullptr) {
+        return nullptr;
+      }
+      p = seq == 1 ? wrapped_codec::Read(type, p, payload_end, v) : SkipField(type, p, payload_end);
+      if (p == nullptr) {
+        return nullptr;
+      }
+    }
+    return p;
+  }
+  static void Clear(Tp* v) noexcept { v->clear(); }
+};
+
+// A singular field. The field that holds the default value will not be written.
+template <class Tp, class>
+struct FieldCodec {
+  using codec = ValueCodec<Tp>;
+
+  template <bool Cached = false>
+  static size_t Size(int32_t seq, const Tp& v) noexcept {
+    if (codec::IsDefault(v)) {
+      return 0;
+    }
+    return VarintSize(MakeTag(seq, codec::wire_type)) + codec::template Size<Cached>(v);
+  }
+
+  static char* Write(int32_t seq, const Tp& v, char* p) noexcept {
+    if (codec::IsDefault(v)) {
+      return p;
+    }
+    p = WriteVarint(MakeTag(seq, codec::wire_type), p);
+    return codec::Write(v, p);
+  }
+
+  static const char* Read(WireType type, const char* p, const char* end, Tp* v) {
+    if (type != codec::wire_type) {
+      return SkipField(type, p, end);
+    }
+    return codec::Read(p, end, v);
+  }
+  static void Clear(Tp* v) { codec::Clear(v); }
+};
+
+// A repeated field. Each element is written as a record, no matter whether it is the default value or not.
+template <class Tp>
+struct FieldCodec<Tp, std::enable_if_t<!IsStringV<Tp> && !IsMessageV<Tp> && !IsPackedListV<Tp> && (IsListV<Tp> || IsMapV<Tp>)>> {
+  using codec = ValueCodec<std::remove_cv_t<typename RepeatedValueType<Tp>::type>>;
+
+  template <bool Cached = false>
+  static size_t Size(int32_t seq, const Tp& v) noexcept {
+    size_t size = VarintSize(MakeTag(seq, codec::wire_type)) * v.size();
+    for (const auto& element : v) {
+      size += codec::template Size<Cached>(element);
+    }
+    return size;
+  }
+
+  static char* Write(int32_t seq, const Tp& v, char* p) noexcept {
+    const uint32_t tag = MakeTag(seq, codec::wire_type);
+    for (const auto& element : v) {
+      p = WriteVarint(tag, p);
+      p = codec::Write(element, p);
+    }
+    return p;
+  }
+
+  // Each record appends an element. A map entry overwrites the existing one with the same key.
+  // The elements of an arena container are decoded on its resource, see ArenaTraits.
+  static const char* Read(WireType type, const char* p, const char* end, Tp* v) {
+    if (type != codec::wire_type) {
+      return SkipField(type, p, end);
+    }
+    if constexpr (IsMapV<Tp>) {
+      using mapped_type = typename MapTraits<Tp>::mapped_type;
+      std::pair<typename MapTraits<Tp>::key_type, mapped_type> entry{};
+      ArenaTraits<Tp>::Bind(*v, entry.first);
+      ArenaTraits<Tp>::Bind(*v, entry.second);
+      size_t len = 0;
+      p = ReadLength(p, end, &len);
+      if (p == nullptr || (p = ReadEntry(p, p + len, &entry.first, &entry.second)) == nullptr) {
+        return nullptr;
+      }
+      size_t size = v->size();
+      auto& mapped = (*v)[std::move(entry.first)];
+      if (v->size() != size) {
+        ArenaTraits<Tp>::BindElement(*v, mapped);
+      }
+      mapped = std::move(entry.second);
+      return p;
+    } else if constexpr (std::is_same_v<typename ListTraits<Tp>::value_type, bool>) {
+      bool element = false;
+      p = codec::Read(p, end, &element);
+      v->push_back(element);
+      return p;
+    } else {
+      v->emplace_back();
+      ArenaTraits<Tp>::BindElement(*v, v->back());
+      return codec::Read(p, end, &v->back());
+    }
+  }
+  static void Clear(Tp* v) noexcept { v->clear(); }
+};
+
+// A packed repeated field of numbers. An empty list is not written.
+template <class Tp>
+struct FieldCodec<Tp, std::enable_if_t<IsPackedListV<Tp>>> {
+  using value_type = std::remove_cv_t<typename ListTraits<Tp>::value_type>;
+  using codec = ValueCodec<value_type>;
+  static constexpr bool is_varint = codec::wire_type == WireType::VARINT;
+  // The fixed-width elements of a contiguous list are exactly the same as their wire format on the little endian machine.
+  static constexpr bool is_memcpy = !is_varint && kLittleEndian && IsContiguousListV<Tp>;
+
+  static size_t PayloadSize(const Tp& v) noexcept {
+    if constexpr (!is_varint) {
+      return v.size() * sizeof(value_type);
+    } else if constexpr (IsContiguousListV<Tp>) {
+      return PackedVarintSize<codec>(v.data(), v.size());
+    } else {
+      size_t size = 0;
+      for (const auto& element : v) {
+        size += codec::Size(element);
+      }
+      return size;
+    }
+  }
+
+  template <bool Cached = false>
+  static size_t Size(int32_t seq, const Tp& v) noexcept {
+    if (v.empty()) {
+      return 0;
+    }
+    return VarintSize(MakeTag(seq, WireType::LENGTH_DELIMITED)) + LengthDelimitedSize(PayloadSize(v));
+  }
+
+  static char* Write(int32_t seq, const Tp& v, char* p) noexcept {
+    if (v.empty()) {
+      return p;
+    }
+    p = WriteVarint(MakeTag(seq, WireType::LENGTH_DELIMITED), p);
+    p = WriteVarint(PayloadSize(v), p);
+    if constexpr (is_memcpy) {
+      return WriteBytes(v.data(), v.size() * sizeof(value_type), p);
+    } else if constexpr (is_varint && IsContiguousListV<Tp>) {
+      return EncodePackedVarints<codec>(v.data(), v.size(), p);
+    } else {
+      for (const auto& element : v) {
+        p = codec::Write(element, p);
+      }
+      return p;
+    }
+  }
+
+  static const char* Read(WireType type, const char* p, const char* end, Tp* v) {
+    if (type == codec::wire_type) {
+      value_type element{};
+      p = codec::Read(p, end, &element);
+      if (p != nullptr) {
+        v->push_back(element);
+      }
+      return p;
+    }
+    if (type != WireType::LENGTH_DELIMITED) {
+      return SkipField(type, p, end);
+    }
+    size_t len = 0;
+    p = ReadLength(p, end, &len);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    const char* payload_end = p + len;
+    if constexpr (IsContiguousListV<Tp>) {
+      size_t count = 0;
+      if constexpr (is_varint) {
+        count = CountVarints(p, payload_end);
+      } else if (len % sizeof(value_type) != 0) {
+        return nullptr;
+      } else {
+        count = len / sizeof(value_type);
+      }
+      size_t old_size = v->size();
+      v->resize(old_size + count);
+      if constexpr (is_varint) {
+        return DecodePackedVarints<codec>(p, payload_end, v->data() + old_size, count);
+      } else if constexpr (is_memcpy) {
+        std::memcpy(v->data() + old_size, p, len);
+        return payload_end;
+      } else {
+        for (size_t i = old_size; i < v->size(); i++) {
+          p = codec::Read(p, payload_end, v->data() + i);
+        }
+        return p;
+      }
+    } else {
+      while (p < payload_end) {
+        value_type element{};
+        if ((p = codec::Read(p, payload_end, &element)) == nullptr) {
+          return nullptr;
+        }
+        v->push_back(element);
+      }
+      return p;
+    }
+  }
+
+  static void Clear(Tp* v) noexcept { v->clear(); }
+};
+
+template <class Tp>
+size_t FieldByteSize(int32_t seq, const Tp& v) noexcept {
+  return FieldCodec<std::remove_cv_t<Tp>>::Size(seq, v);
+}
+
+template <class Tp>
+char* WriteField(int32_t seq, const Tp& v, char* p) noexcept {
+  return FieldCodec<std::remove_cv_t<Tp>>::Write(seq, v, p);
+}
+
+template <class Tp>
+const char* ReadField(WireType type, const char* p, const char* end, Tp* v) {
+  return FieldCodec<Tp>::Read(type, p, end, v);
+}
+
+template <class Tp>
+void ClearField(Tp* v) {
+  FieldCodec<Tp>::Clear(v);
+}
+
+}  // namespace internal
+
+}  // namespace liteproto
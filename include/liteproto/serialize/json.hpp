@@ -0,0 +1,553 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "liteproto/serialize/binary.hpp"
+#include "liteproto/serialize/resolver.hpp"
+#include "liteproto/traits/traits.hpp"
+#include "liteproto/utils.hpp"
+#include "rapidjson/rapidjson.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+namespace liteproto {
+
+namespace internal {
+
+// A value is emitted to a SAX writer (e.g., rapidjson::Writer) by the Resolver with a JsonReceiver, so the whole
+// traversal is unrolled at compile time. The writer functions return false on failure (e.g., a NaN double), which stops
+// the traversal.
+// JsonCodec offers the callbacks to fill a value with the events of a SAX reader, see JsonHandler. A reader event that
+// doesn't match the type (e.g., a string for an int field, or an out-of-range number) fails the parsing.
+//
+// The types are mapped to JSON as below.
+// bool: true or false. Integers and enums: number. float and double: number.
+// String and std::string_view: string.
+// Message: object, the keys are the field names in the order of the seq number.
+// List: array.
+// Map: object if the key is a string, a number or a bool, in which case the numbers and the bools are stringified like
+// protobuf. Otherwise it is an array of pairs.
+// Pair: array [first, second].
+// The reader doesn't accept the maps of which the key is neither a string, a number nor a bool. A std::string_view is
+// only filled by the strings that point into the input, i.e., when parsing in situ.
+
+struct JsonOps;
+
+// The value that the next reader event goes to. A null ops means the value is skipped, e.g., an unknown field.
+struct JsonSlot {
+  void* target;
+  const JsonOps* ops;
+};
+
+// The type-erased callbacks of JsonCodec for the reader.
+struct JsonOps {
+  bool (*on_bool)(void*, bool);
+  bool (*on_int64)(void*, int64_t);
+  bool (*on_uint64)(void*, uint64_t);
+  bool (*on_double)(void*, double);
+  bool (*on_string)(void*, const char*, size_t, bool);
+  bool (*begin_object)(void*);
+  bool (*begin_array)(void*);
+  bool (*on_key)(void*, const char*, size_t, JsonSlot*);
+  bool (*on_element)(void*, size_t, JsonSlot*);
+};
+
+// All the reader callbacks reject the event by default, a codec hides the ones that it accepts.
+struct JsonReaderBase {
+  static bool OnBool(void*, bool) noexcept { return false; }
+  static bool OnInt64(void*, int64_t) noexcept { return false; }
+  static bool OnUint64(void*, uint64_t) noexcept { return false; }
+  static bool OnDouble(void*, double) noexcept { return false; }
+  static bool OnString(void*, const char*, size_t, bool) noexcept { return false; }
+  static bool BeginObject(void*) noexcept { return false; }
+  static bool BeginArray(void*) noexcept { return false; }
+  static bool OnKey(void*, const char*, size_t, JsonSlot*) noexcept { return false; }
+  static bool OnElement(void*, size_t, JsonSlot*) noexcept { return false; }
+};
+
+template <class Codec>
+const JsonOps* GetJsonOpsOf() noexcept {
+  static constexpr JsonOps ops{&Codec::OnBool,      &Codec::OnInt64,    &Codec::OnUint64, &Codec::OnDouble,  &Codec::OnString,
+                               &Codec::BeginObject, &Codec::BeginArray, &Codec::OnKey,    &Codec::OnElement};
+  return &ops;
+}
+
+template <class Tp, class = void>
+struct JsonCodec {
+  static_assert(!std::is_same_v<Tp, Tp>, "this type cannot be converted to json");
+};
+
+template <class Tp>
+const JsonOps* GetJsonOps() noexcept {
+  return GetJsonOpsOf<JsonCodec<Tp>>();
+}
+
+template <class Tp>
+inline constexpr bool IsJsonStringV = IsStringV<Tp> || std::is_same_v<std::remove_cv_t<Tp>, std::string_view>;
+
+template <class Tp>
+inline constexpr bool IsJsonKeyV = IsJsonStringV<Tp> || std::is_arithmetic_v<Tp> || std::is_enum_v<Tp>;
+
+// A Receiver of the Resolver that emits to a SAX writer. The keys of a map are stringified if the map is written as an
+// object, so the receiver remembers which maps are written as arrays, one bit for each level of the nested maps.
+template <class Writer>
+class JsonReceiver {
+ public:
+  explicit JsonReceiver(Writer& writer) noexcept : writer_(writer) {}
+
+  bool OnBool(bool v) {
+    if (key_pending_) {
+      return v ? Key("true") : Key("false");
+    }
+    return writer_.Bool(v);
+  }
+  bool OnInt64(int64_t v) { return key_pending_ ? IntegerKey(v) : writer_.Int64(v); }
+  bool OnUInt64(uint64_t v) { return key_pending_ ? IntegerKey(v) : writer_.Uint64(v); }
+  bool OnFloat64(double v) {
+    if (key_pending_) {
+      char buf[32];
+      int n = std::snprintf(buf, sizeof buf, "%.17g", v);
+      return Key(std::string_view{buf, static_cast<size_t>(n)});
+    }
+    return writer_.Double(v);
+  }
+  bool OnString(std::string_view v) {
+    return key_pending_ ? Key(v) : writer_.String(v.data(), static_cast<rapidjson::SizeType>(v.size()));
+  }
+
+  bool BeginList(size_t) { return writer_.StartArray(); }
+  bool EndList() { return writer_.EndArray(); }
+
+  bool BeginMap(size_t, Kind key) {
+    if (map_depth_ == 64) {
+      return false;
+    }
+    bool as_array = key != Kind::NUMBER && key != Kind::STRING;
+    array_maps_ = (array_maps_ << 1) | static_cast<uint64_t>(as_array);
+    map_depth_++;
+    return as_array ? writer_.StartArray() : writer_.StartObject();
+  }
+  bool BeginEntry() {
+    if (array_maps_ & 1) {
+      return writer_.StartArray();
+    }
+    key_pending_ = true;
+    return true;
+  }
+  bool EndEntry() { return (array_maps_ & 1) ? writer_.EndArray() : true; }
+  bool EndMap() {
+    bool as_array = array_maps_ & 1;
+    array_maps_ >>= 1;
+    map_depth_--;
+    return as_array ? writer_.EndArray() : writer_.EndObject();
+  }
+
+  bool BeginPair() { return writer_.StartArray(); }
+  bool EndPair() { return writer_.EndArray(); }
+
+  bool BeginMessage(size_t) { return writer_.StartObject(); }
+  bool OnField(std::string_view name, int32_t) { return Key(name); }
+  bool EndMessage() { return writer_.EndObject(); }
+
+ private:
+  bool Key(std::string_view key) {
+    key_pending_ = false;
+    return writer_.Key(key.data(), static_cast<rapidjson::SizeType>(key.size()));
+  }
+
+  template <class Integer>
+  bool IntegerKey(Integer v) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof buf, v);
+    return Key(std::string_view{buf, static_cast<size_t>(res.ptr - buf)});
+  }
+
+  Writer& writer_;
+  uint64_t array_maps_ = 0;
+  uint32_t map_depth_ = 0;
+  bool key_pending_ = false;
+};
+
+template <class Writer, class Tp>
+bool WriteJson(Writer& writer, const Tp& v) {
+  JsonReceiver<Writer> receiver(writer);
+  return Resolve(v, receiver);
+}
+
+template <class Tp>
+bool ParseJsonKey(const char* data, size_t size, Tp* key) {
+  if constexpr (IsStringV<Tp>) {
+    key->assign(data, size);
+    return true;
+  } else if constexpr (std::is_same_v<Tp, bool>) {
+    std::string_view str{data, size};
+    *key = str == "true";
+    return *key || str == "false";
+  } else if constexpr (std::is_enum_v<Tp>) {
+    std::underlying_type_t<Tp> underlying;
+    if (!ParseJsonKey(data, size, &underlying)) {
+      return false;
+    }
+    *key = static_cast<Tp>(underlying);
+    return true;
+  } else if constexpr (std::is_integral_v<Tp>) {
+    auto res = std::from_chars(data, data + size, *key);
+    return res.ec == std::errc() && res.ptr == data + size;
+  } else if constexpr (std::is_floating_point_v<Tp>) {
+    std::string str{data, size};
+    char* end = nullptr;
+    *key = static_cast<Tp>(std::strtod(str.c_str(), &end));
+    return size != 0 && end == str.c_str() + size;
+  } else {
+    return false;
+  }
+}
+
+template <class Tp>
+struct JsonCodec<Tp, std::enable_if_t<std::is_arithmetic_v<Tp> || std::is_enum_v<Tp>>> : JsonReaderBase {
+  static bool OnBool(void* target, bool v) noexcept {
+    if constexpr (std::is_same_v<Tp, bool>) {
+      *static_cast<Tp*>(target) = v;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  template <class Integer>
+  static bool OnInteger(void* target, Integer v) noexcept {
+    if constexpr (std::is_same_v<Tp, bool>) {
+      return false;
+    } else if constexpr (std::is_enum_v<Tp>) {
+      std::underlying_type_t<Tp> underlying;
+      if (!JsonCodec<std::underlying_type_t<Tp>>::OnInteger(&underlying, v)) {
+        return false;
+      }
+      *static_cast<Tp*>(target) = static_cast<Tp>(underlying);
+      return true;
+    } else if constexpr (std::is_floating_point_v<Tp>) {
+      *static_cast<Tp*>(target) = static_cast<Tp>(v);
+      return true;
+    } else {
+      if (std::is_signed_v<Integer> && v < 0) {
+        if (!std::is_signed_v<Tp> || static_cast<int64_t>(v) < static_cast<int64_t>(std::numeric_limits<Tp>::min())) {
+          return false;
+        }
+      } else if (static_cast<uint64_t>(v) > static_cast<uint64_t>(std::numeric_limits<Tp>::max())) {
+        return false;
+      }
+      *static_cast<Tp*>(target) = static_cast<Tp>(v);
+      return true;
+    }
+  }
+
+  static bool OnInt64(void* target, int64_t v) noexcept { return OnInteger(target, v); }
+  static bool OnUint64(void* target, uint64_t v) noexcept { return OnInteger(target, v); }
+
+  static bool OnDouble(void* target, double v) noexcept {
+    if constexpr (std::is_floating_point_v<Tp>) {
+      *static_cast<Tp*>(target) = static_cast<Tp>(v);
+      return true;
+    } else {
+      return false;
+    }
+  }
+};
+
+template <class Tp>
+struct JsonCodec<Tp, std::enable_if_t<IsJsonStringV<Tp>>> : JsonReaderBase {
+  static bool OnString(void* target, const char* data, size_t size, bool copy) {
+    if constexpr (IsStringV<Tp>) {
+      static_cast<Tp*>(target)->assign(data, size);
+      return true;
+    } else {
+      if (copy) {
+        return false;
+      }
+      *static_cast<Tp*>(target) = Tp{data, size};
+      return true;
+    }
+  }
+};
+
+template <class Tp>
+struct JsonCodec<Tp, std::enable_if_t<IsMessageV<Tp>>> : JsonReaderBase {
+  static bool BeginObject(void*) noexcept { return true; }
+
+  // The key is dispatched through the perfect hash over the field names, the unknown fields are skipped. A lazy field is
+  // decoded first, which may allocate.
+  static bool OnKey(void* target, const char* data, size_t size, JsonSlot* slot) {
+    int32_t index = Tp::FindFieldByName(std::string_view{data, size});
+    if (index < 0) {
+      *slot = JsonSlot{nullptr, nullptr};
+    } else {
+      *slot = FieldSlot(static_cast<Tp*>(target), static_cast<size_t>(index),
+                        std::make_index_sequence<Tp::FieldsIndices::value.size()>{});
+    }
+    return true;
+  }
+
+ private:
+  template <size_t I>
+  static JsonSlot FieldSlotAt(Tp* msg) {
+    constexpr auto index = Tp::FieldsIndices::value[I];
+    msg->DecodeLazyField(static_cast<int32_t>(I));
+    auto& field = msg->FIELD_value(int32_constant<index.second>{});
+    return JsonSlot{&field, GetJsonOps<std::remove_reference_t<decltype(field)>>()};
+  }
+
+  template <size_t... I>
+  static JsonSlot FieldSlot(Tp* msg, size_t index, std::index_sequence<I...>) {
+    static constexpr std::array<JsonSlot (*)(Tp*), sizeof...(I)> slots{&FieldSlotAt<I>...};
+    return slots[index](msg);
+  }
+};
+
+template <class Tp>
+struct JsonCodec<Tp, std::enable_if_t<!IsMessageV<Tp> && IsPairV<Tp>>> : JsonReaderBase {
+  static bool BeginArray(void*) noexcept { return true; }
+
+  static bool OnElement(void* target, size_t index, JsonSlot* slot) noexcept {
+    auto pair = static_cast<Tp*>(target);
+    if (index == 0) {
+      *slot = JsonSlot{&pair->first, GetJsonOps<typename PairTraits<Tp>::first_type>()};
+    } else if (index == 1) {
+      *slot = JsonSlot{&pair->second, GetJsonOps<typename PairTraits<Tp>::second_type>()};
+    } else {
+      return false;
+    }
+    return true;
+  }
+};
+
+// The elements of std::vector<bool> are not addressable, so they are appended by the list itself.
+template <class List>
+struct JsonBoolAppender : JsonReaderBase {
+  static bool OnBool(void* target, bool v) {
+    static_cast<List*>(target)->push_back(v);
+    return true;
+  }
+};
+
+template <class Tp>
+struct JsonCodec<Tp, std::enable_if_t<!IsJsonStringV<Tp> && !IsMessageV<Tp> && IsListV<Tp>>> : JsonReaderBase {
+  using value_type = typename ListTraits<Tp>::value_type;
+
+  static bool BeginArray(void* target) noexcept {
+    static_cast<Tp*>(target)->clear();
+    return true;
+  }
+
+  static bool OnElement(void* target, size_t, JsonSlot* slot) {
+    auto list = static_cast<Tp*>(target);
+    if constexpr (std::is_same_v<value_type, bool>) {
+      *slot = JsonSlot{list, GetJsonOpsOf<JsonBoolAppender<Tp>>()};
+    } else {
+      list->emplace_back();
+      ArenaTraits<Tp>::BindElement(*list, list->back());
+      *slot = JsonSlot{&list->back(), GetJsonOps<value_type>()};
+    }
+    return true;
+  }
+};
+
+template <class Tp>
+struct JsonCodec<Tp, std::enable_if_t<!IsMessageV<Tp> && IsMapV<Tp>>> : JsonReaderBase {
+  using key_type = typename MapTraits<Tp>::key_type;
+  using mapped_type = typename MapTraits<Tp>::mapped_type;
+
+  static bool BeginObject(void* target) noexcept {
+    static_cast<Tp*>(target)->clear();
+    return IsJsonKeyV<key_type> && !std::is_same_v<key_type, std::string_view>;
+  }
+
+  static bool OnKey(void* target, const char* data, size_t size, JsonSlot* slot) {
+    auto map = static_cast<Tp*>(target);
+    key_type key{};
+    ArenaTraits<Tp>::Bind(*map, key);
+    if (!ParseJsonKey(data, size, &key)) {
+      return false;
+    }
+    size_t map_size = map->size();
+    auto& value = (*map)[std::move(key)];
+    if (map->size() != map_size) {
+      ArenaTraits<Tp>::BindElement(*map, value);
+    }
+    *slot = JsonSlot{&value, GetJsonOps<mapped_type>()};
+    return true;
+  }
+};
+
+}  // namespace internal
+
+// Emit the message to a rapidjson SAX writer, without building any Object or Document. Return false if the writer fails.
+template <class Msg, class Writer, class = std::enable_if_t<IsMessageV<Msg>>>
+bool ToJson(const Msg& msg, Writer& writer) {
+  return internal::WriteJson(writer, msg);
+}
+
+template <class Msg, class = std::enable_if_t<IsMessageV<Msg>>>
+bool ToJsonString(const Msg& msg, std::string* output) {
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  if (!ToJson(msg, writer)) {
+    return false;
+  }
+  output->assign(buffer.GetString(), buffer.GetSize());
+  return true;
+}
+
+// A rapidjson SAX handler which fills the message directly, e.g.,
+//   JsonHandler handler(&msg);
+//   reader.Parse(stream, handler);
+// The fields are assigned in place, so the message should be cleared before parsing, which is what FromJson() does.
+// Each nested object or array pushes a frame to the stack, which is the only allocation besides the fields.
+class JsonHandler {
+ public:
+  template <class Msg, class = std::enable_if_t<IsMessageV<Msg>>>
+  explicit JsonHandler(Msg* msg) noexcept : root_{msg, internal::GetJsonOps<Msg>()} {}
+
+  bool Null() {
+    internal::JsonSlot slot;
+    // null means the default value, which is left untouched.
+    return NextSlot(&slot);
+  }
+  bool Bool(bool b) {
+    internal::JsonSlot slot;
+    return NextSlot(&slot) && (slot.ops == nullptr || slot.ops->on_bool(slot.target, b));
+  }
+  bool Int(int i) { return Int64(i); }
+  bool Uint(unsigned u) { return Uint64(u); }
+  bool Int64(int64_t i) {
+    internal::JsonSlot slot;
+    return NextSlot(&slot) && (slot.ops == nullptr || slot.ops->on_int64(slot.target, i));
+  }
+  bool Uint64(uint64_t u) {
+    internal::JsonSlot slot;
+    return NextSlot(&slot) && (slot.ops == nullptr || slot.ops->on_uint64(slot.target, u));
+  }
+  bool Double(double d) {
+    internal::JsonSlot slot;
+    return NextSlot(&slot) && (slot.ops == nullptr || slot.ops->on_double(slot.target, d));
+  }
+  bool RawNumber(const char*, rapidjson::SizeType, bool) { return false; }
+  bool String(const char* str, rapidjson::SizeType length, bool copy) {
+    internal::JsonSlot slot;
+    return NextSlot(&slot) && (slot.ops == nullptr || slot.ops->on_string(slot.target, str, length, copy));
+  }
+
+  bool StartObject() { return Begin(false); }
+  bool Key(const char* str, rapidjson::SizeType length, bool) {
+    if (stack_.empty() || stack_.back().is_array || stack_.back().has_key) {
+      return false;
+    }
+    auto& top = stack_.back();
+    top.has_key = true;
+    if (top.container.ops == nullptr) {
+      top.pending = internal::JsonSlot{nullptr, nullptr};
+      return true;
+    }
+    return top.container.ops->on_key(top.container.target, str, length, &top.pending);
+  }
+  bool EndObject(rapidjson::SizeType) { return End(false); }
+
+  bool StartArray() { return Begin(true); }
+  bool EndArray(rapidjson::SizeType) { return End(true); }
+
+ private:
+  struct Frame {
+    internal::JsonSlot container;
+    internal::JsonSlot pending;
+    size_t size;
+    bool is_array;
+    bool has_key;
+  };
+
+  // Find where the next value goes: the root, the value of the last key, or a new element of the array.
+  bool NextSlot(internal::JsonSlot* slot) {
+    if (stack_.empty()) {
+      if (root_consumed_) {
+        return false;
+      }
+      root_consumed_ = true;
+      *slot = root_;
+      return true;
+    }
+    auto& top = stack_.back();
+    if (top.is_array) {
+      if (top.container.ops == nullptr) {
+        *slot = internal::JsonSlot{nullptr, nullptr};
+        return true;
+      }
+      return top.container.ops->on_element(top.container.target, top.size++, slot);
+    }
+    if (!top.has_key) {
+      return false;
+    }
+    top.has_key = false;
+    *slot = top.pending;
+    return true;
+  }
+
+  bool Begin(bool is_array) {
+    internal::JsonSlot slot;
+    if (!NextSlot(&slot)) {
+      return false;
+    }
+    if (slot.ops != nullptr && !(is_array ? slot.ops->begin_array(slot.target) : slot.ops->begin_object(slot.target))) {
+      return false;
+    }
+    stack_.push_back(Frame{slot, internal::JsonSlot{nullptr, nullptr}, 0, is_array, false});
+    return true;
+  }
+
+  bool End(bool is_array) {
+    if (stack_.empty() || stack_.back().is_array != is_array) {
+      return false;
+    }
+    stack_.pop_back();
+    return true;
+  }
+
+  internal::JsonSlot root_;
+  bool root_consumed_ = false;
+  std::vector<Frame> stack_;
+};
+
+// Parse the message from a null-terminated json string, all the fields are cleared first.
+template <class Msg, class = std::enable_if_t<IsMessageV<Msg>>>
+bool FromJson(const char* json, Msg* msg) {
+  internal::ClearField(msg);
+  JsonHandler handler(msg);
+  rapidjson::Reader reader;
+  rapidjson::StringStream stream(json);
+  return !reader.Parse(stream, handler).IsError();
+}
+
+template <class Msg, class = std::enable_if_t<IsMessageV<Msg>>>
+bool FromJson(const std::string& json, Msg* msg) {
+  return FromJson(json.c_str(), msg);
+}
+
+// Parse in situ, i.e., the json string is modified, and the strings of the message may point into it.
+template <class Msg, class = std::enable_if_t<IsMessageV<Msg>>>
+bool FromJsonInsitu(char* json, Msg* msg) {
+  internal::ClearField(msg);
+  JsonHandler handler(msg);
+  rapidjson::Reader reader;
+  rapidjson::InsituStringStream stream(json);
+  return !reader.Parse<rapidjson::kParseInsituFlag>(stream, handler).IsError();
+}
+
+}  // namespace liteproto
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "liteproto/serialize/wire_format.hpp"
+
+// The varint kernels of the packed repeated fields. Most of the samples in a packed field are small, so the kernels
+// check a whole block of elements (or bytes) at once with SSE2/AVX2, and take the fast path if every element in the
+// block fits in a single byte. The other blocks fall back to the scalar code, which is also the only code path if the
+// SIMD is unavailable or disabled by LITE_PROTO_DISABLE_SIMD_. The AVX2 kernels are only compiled with -mavx2, see the
+// CMake option LITE_PROTO_ENABLE_AVX2.
+#if !defined(LITE_PROTO_DISABLE_SIMD_)
+#if defined(__AVX2__)
+#define LITE_PROTO_AVX2_ 1
+#endif
+#if defined(__SSE2__)
+#define LITE_PROTO_SSE2_ 1
+#endif
+#endif
+
+#if defined(LITE_PROTO_SSE2_) || defined(LITE_PROTO_AVX2_)
+#include <immintrin.h>
+#endif
+
+namespace liteproto {
+
+namespace internal {
+
+// The portable forms of __builtin_popcount() and __builtin_ctz().
+inline int PopCount32(uint32_t v) noexcept {
+#if defined(__GNUC__)
+  return __builtin_popcount(v);
+#else
+  int count = 0;
+  for (; v != 0; v &= v - 1) {
+    count++;
+  }
+  return count;
+#endif
+}
+
+// v must not be 0.
+inline int CountTrailingZeros32(uint32_t v) noexcept {
+#if defined(__GNUC__)
+  return __builtin_ctz(v);
+#else
+  int count = 0;
+  for (; (v & 1) == 0; v >>= 1) {
+    count++;
+  }
+  return count;
+#endif
+}
+
+// Codec is the ValueCodec of Tp, which offers ToWire() and FromWire().
+
+template <class Codec, class Tp>
+size_t PackedVarintSize(const Tp* data, size_t n) noexcept {
+  size_t size = 0, i = 0;
+#if defined(LITE_PROTO_SSE2_)
+  if constexpr (std::is_integral_v<Tp> && sizeof(Tp) == 4) {
+    // Each lane counts 1 + [v > 2^7 - 1] + [v > 2^14 - 1] + ..., and 10 for a negative signed value. The unsigned values
+    // are compared after flipping the sign bit. The lanes are flushed before they may overflow.
+    constexpr bool is_signed = std::is_signed_v<Tp>;
+    constexpr int32_t bias = is_signed ? 0 : INT32_MIN;
+    constexpr size_t flush_every = 1 << 24;
+#if defined(LITE_PROTO_AVX2_)
+    const __m256i bias8 = _mm256_set1_epi32(bias);
+    while (n - i >= 8) {
+      __m256i acc = _mm256_setzero_si256();
+      for (size_t round = 0; round < flush_every && n - i >= 8; round++, i += 8) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), bias8);
+        acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(v, _mm256_set1_epi32((0x7f) ^ bias)));
+        acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(v, _mm256_set1_epi32((0x3fff) ^ bias)));
+        acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(v, _mm256_set1_epi32((0x1fffff) ^ bias)));
+        acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(v, _mm256_set1_epi32((0xfffffff) ^ bias)));
+        if constexpr (is_signed) {
+          acc = _mm256_add_epi32(acc, _mm256_and_si256(_mm256_srai_epi32(v, 31), _mm256_set1_epi32(9)));
+        }
+      }
+      alignas(32) uint32_t lanes[8];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+      for (uint32_t lane : lanes) {
+        size += lane;
+      }
+    }
+#endif
+    const __m128i bias4 = _mm_set1_epi32(bias);
+    while (n - i >= 4) {
+      __m128i acc = _mm_setzero_si128();
+      for (size_t round = 0; round < flush_every && n - i >= 4; round++, i += 4) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), bias4);
+        acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(v, _mm_set1_epi32((0x7f) ^ bias)));
+        acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(v, _mm_set1_epi32((0x3fff) ^ bias)));
+        acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(v, _mm_set1_epi32((0x1fffff) ^ bias)));
+        acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(v, _mm_set1_epi32((0xfffffff) ^ bias)));
+        if constexpr (is_signed) {
+          acc = _mm_add_epi32(acc, _mm_and_si128(_mm_srai_epi32(v, 31), _mm_set1_epi32(9)));
+        }
+      }
+      alignas(16) uint32_t lanes[4];
+      _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+      for (uint32_t lane : lanes) {
+        size += lane;
+      }
+    }
+    size += i;  // the leading byte of each element.
+  }
+#endif
+  for (; i < n; i++) {
+    size += VarintSize(Codec::ToWire(data[i]));
+  }
+  return size;
+}
+
+// Return true if all the 16 elements starting from data fit in a single byte.
+template <class Tp>
+bool IsSmallBlock16(const Tp* data) noexcept {
+#if defined(LITE_PROTO_AVX2_)
+  if constexpr (sizeof(Tp) == 4 || sizeof(Tp) == 8) {
+    constexpr size_t step = 32 / sizeof(Tp);
+    __m256i bits = _mm256_setzero_si256();
+    for (size_t k = 0; k < 16; k += step) {
+      bits = _mm256_or_si256(bits, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + k)));
+    }
+    const __m256i high = sizeof(Tp) == 4 ? _mm256_set1_epi32(~0x7f) : _mm256_set1_epi64x(~int64_t{0x7f});
+    return _mm256_testz_si256(bits, high) != 0;
+  }
+#endif
+#if defined(LITE_PROTO_SSE2_)
+  if constexpr (sizeof(Tp) == 4 || sizeof(Tp) == 8) {
+    constexpr size_t step = 16 / sizeof(Tp);
+    __m128i bits = _mm_setzero_si128();
+    for (size_t k = 0; k < 16; k += step) {
+      bits = _mm_or_si128(bits, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + k)));
+    }
+    const __m128i high = sizeof(Tp) == 4 ? _mm_set1_epi32(~0x7f) : _mm_set1_epi64x(~int64_t{0x7f});
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(bits, high), _mm_setzero_si128())) == 0xffff;
+  }
+#endif
+  uint64_t bits = 0;
+  for (size_t k = 0; k < 16; k++) {
+    bits |= static_cast<uint64_t>(data[k]);
+  }
+  return (bits & ~uint64_t{0x7f}) == 0;
+}
+
+template <class Codec, class Tp>
+char* EncodePackedVarints(const Tp* data, size_t n, char* p) noexcept {
+  size_t i = 0;
+  if constexpr (std::is_integral_v<Tp> && (sizeof(Tp) == 4 || sizeof(Tp) == 8)) {
+    for (; n - i >= 16; i += 16) {
+      if (!IsSmallBlock16(data + i)) {
+        for (size_t k = i; k < i + 16; k++) {
+          p = WriteVarint(Codec::ToWire(data[k]), p);
+        }
+        continue;
+      }
+#if defined(LITE_PROTO_SSE2_)
+      if constexpr (sizeof(Tp) == 4) {
+        // Every element is in [0, 127], so the saturated packing is exact.
+        auto block = reinterpret_cast<const __m128i*>(data + i);
+        __m128i lo = _mm_packs_epi32(_mm_loadu_si128(block), _mm_loadu_si128(block + 1));
+        __m128i hi = _mm_packs_epi32(_mm_loadu_si128(block + 2), _mm_loadu_si128(block + 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(lo, hi));
+        p += 16;
+        continue;
+      }
+#endif
+      for (size_t k = 0; k < 16; k++) {
+        p[k] = static_cast<char>(data[i + k]);
+      }
+      p += 16;
+    }
+  }
+  for (; i < n; i++) {
+    p = WriteVarint(Codec::ToWire(data[i]), p);
+  }
+  return p;
+}
+
+// Count the varints in [p, end), i.e., the bytes without the continuation bit.
+inline size_t CountVarints(const char* p, const char* end) noexcept {
+  size_t count = 0;
+#if defined(LITE_PROTO_AVX2_)
+  for (; end - p >= 32; p += 32) {
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))));
+    count += 32 - static_cast<size_t>(PopCount32(mask));
+  }
+#endif
+#if defined(LITE_PROTO_SSE2_)
+  for (; end - p >= 16; p += 16) {
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+    count += 16 - static_cast<size_t>(PopCount32(mask));
+  }
+#endif
+  for (; p < end; p++) {
+    count += static_cast<uint8_t>(*p) < 0x80;
+  }
+  return count;
+}
+
+// Decode exactly n varints in [p, end) to out, return nullptr if they don't take up the whole range.
+template <class Codec, class Tp>
+const char* DecodePackedVarints(const char* p, const char* end, Tp* out, size_t n) noexcept {
+  size_t i = 0;
+#if defined(LITE_PROTO_SSE2_)
+  while (end - p >= 16 && n - i >= 16) {
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+    // The leading single-byte varints of the block.
+    size_t small = mask == 0 ? 16 : static_cast<size_t>(CountTrailingZeros32(mask));
+#if defined(LITE_PROTO_AVX2_)
+    if constexpr (std::is_integral_v<Tp> && sizeof(Tp) == 4) {
+      if (small == 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtepu8_epi32(bytes));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+        p += 16;
+        i += 16;
+        continue;
+      }
+    }
+#endif
+    for (size_t k = 0; k < small; k++) {
+      out[i + k] = Codec::FromWire(static_cast<uint8_t>(p[k]));
+    }
+    p += small;
+    i += small;
+    if (small != 16) {
+      uint64_t v;
+      if ((p = ReadVarint(p, end, &v)) == nullptr) {
+        return nullptr;
+      }
+      out[i++] = Codec::FromWire(v);
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    uint64_t v;
+    if ((p = ReadVarint(p, end, &v)) == nullptr) {
+      return nullptr;
+    }
+    out[i] = Codec::FromWire(v);
+  }
+  return p == end ? p : nullptr;
+}
+
+}  // namespace internal
+
+}  // namespace liteproto
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "liteproto/compare.hpp"
+#include "liteproto/message.hpp"
+#include "liteproto/serialize/binary.hpp"
+#include "liteproto/serialize/wire_format.hpp"
+#include "liteproto/traits/traits.hpp"
+
+namespace liteproto {
+
+namespace internal {
+
+// A delta is a sequence of records in the wire format, one length-delimited record for each changed field, whose field
+// number is the seq number of the field. The payload of a record is an embedded message which starts with the
+// operation on the field:
+// REPLACE: {1: 0, 2: the new value as the records of the field}. No value means the default value.
+// PATCH_MESSAGE: {1: 1, 2: the delta of the embedded message}.
+// PATCH_LIST: {1: 2, 3: the new size, 4: the changed elements}, each changed element is an embedded message
+// {1: index, 2: the new value as the records of a singular field, 3: the delta of an embedded message}.
+// The elements past the old size are always written, so the new size is bounded by the length of the delta.
+enum class PatchOp : uint64_t { REPLACE = 0, PATCH_MESSAGE = 1, PATCH_LIST = 2 };
+
+// Only a list with random access is patched by the elements, the other fields are replaced as a whole.
+template <class Tp, class = void>
+struct IsPatchableList : std::false_type {};
+
+template <class Tp>
+struct IsPatchableList<Tp, std::enable_if_t<!IsStringV<Tp> && !IsMessageV<Tp> && IsListV<Tp>>>
+    : std::bool_constant<
+          std::is_base_of_v<std::random_access_iterator_tag,
+                            typename std::iterator_traits<decltype(std::declval<Tp&>().begin())>::iterator_category> &&
+          !std::is_same_v<std::remove_cv_t<typename ListTraits<Tp>::value_type>, bool>> {};
+
+template <class Tp>
+inline constexpr bool IsPatchableListV = IsPatchableList<Tp>::value;
+
+inline void AppendVarint(std::string* out, uint64_t v) {
+  char buffer[kMaxVarintSize];
+  out->append(buffer, WriteVarint(v, buffer) - buffer);
+}
+
+inline void AppendVarintField(std::string* out, int32_t seq, uint64_t v) {
+  AppendVarint(out, MakeTag(seq, WireType::VARINT));
+  AppendVarint(out, v);
+}
+
+inline void AppendBytesField(std::string* out, int32_t seq, std::string_view bytes) {
+  AppendVarint(out, MakeTag(seq, WireType::LENGTH_DELIMITED));
+  AppendVarint(out, bytes.size());
+  out->append(bytes);
+}
+
+template <class Tp>
+void AppendField(std::string* out, int32_t seq, const Tp& v) {
+  size_t offset = out->size();
+  out->resize(offset + FieldCodec<Tp>::Size(seq, v));
+  FieldCodec<Tp>::Write(seq, v, out->data() + offset);
+}
+
+template <class Tp>
+void DiffList(const Tp& old_list, const Tp& new_list, std::string* out) {
+  using value_type = std::remove_cv_t<typename ListTraits<Tp>::value_type>;
+  AppendVarintField(out, 1, static_cast<uint64_t>(PatchOp::PATCH_LIST));
+  AppendVarintField(out, 3, new_list.size());
+  const size_t common = std::min(old_list.size(), new_list.size());
+  std::string element;
+  for (size_t i = 0; i < new_list.size(); i++) {
+    if (i < common && ValueEquals<value_type>(old_list[i], new_list[i])) {
+      continue;
+    }
+    element.clear();
+    AppendVarintField(&element, 1, i);
+    if constexpr (IsMessageV<value_type>) {
+      if (i < common) {
+        std::string delta;
+        PatchCodec<value_type>::Diff(old_list[i], new_list[i], &delta);
+        AppendBytesField(&element, 3, delta);
+        AppendBytesField(out, 4, element);
+        continue;
+      }
+    }
+    AppendField<value_type>(&element, 2, new_list[i]);
+    AppendBytesField(out, 4, element);
+  }
+}
+
+// Append the record of the field if the value is changed.
+template <class Tp>
+void DiffField(int32_t seq, const Tp& old_value, const Tp& new_value, std::string* out) {
+  if (ValueEquals(old_value, new_value)) {
+    return;
+  }
+  std::string payload;
+  if constexpr (IsMessageV<Tp>) {
+    std::string delta;
+    PatchCodec<Tp>::Diff(old_value, new_value, &delta);
+    AppendVarintField(&payload, 1, static_cast<uint64_t>(PatchOp::PATCH_MESSAGE));
+    AppendBytesField(&payload, 2, delta);
+  } else {
+    if constexpr (IsPatchableListV<Tp>) {
+      DiffList(old_value, new_value, &payload);
+    }
+    // The list is replaced as a whole if most of the elements are changed.
+    const size_t replace_size = VarintSize(MakeTag(1, WireType::VARINT)) + 1 + FieldCodec<Tp>::Size(2, new_value);
+    if (payload.empty() || payload.size() >= replace_size) {
+      payload.clear();
+      AppendVarintField(&payload, 1, static_cast<uint64_t>(PatchOp::REPLACE));
+      AppendField(&payload, 2, new_value);
+    }
+  }
+  AppendBytesField(out, seq, payload);
+}
+
+// Apply the change of an element {1: index, 2: value, 3: delta} to the list.
+template <class Tp>
+const char* PatchElement(Tp* list, const char* p, const char* end) {
+  using value_type = std::remove_cv_t<typename ListTraits<Tp>::value_type>;
+  value_type* element = nullptr;
+  bool patched = false;
+  while (p < end) {
+    int32_t seq;
+    WireType type;
+    if ((p = ReadTag(p, end, &seq, &type)) == nullptr) {
+      return nullptr;
+    }
+    if (seq == 1 && type == WireType::VARINT) {
+      uint64_t index;
+      if ((p = ReadVarint(p, end, &index)) == nullptr || index >= list->size()) {
+        return nullptr;
+      }
+      element = &(*list)[index];
+    } else if ((seq == 2 || seq == 3) && element == nullptr) {
+      return nullptr;
+    } else if (seq == 2) {
+      if (!patched) {
+        FieldCodec<value_type>::Clear(element);
+        patched = true;
+      }
+      p = FieldCodec<value_type>::Read(type, p, end, element);
+    } else if (seq == 3 && type == WireType::LENGTH_DELIMITED) {
+      if constexpr (IsMessageV<value_type>) {
+        size_t len;
+        if ((p = ReadLength(p, end, &len)) == nullptr || PatchCodec<value_type>::Apply(element, p, p + len) == nullptr) {
+          return nullptr;
+        }
+        p += len;
+        patched = true;
+      } else {
+        return nullptr;
+      }
+    } else {
+      p = SkipField(type, p, end);
+    }
+    if (p == nullptr) {
+      return nullptr;
+    }
+  }
+  if (element == nullptr) {
+    return nullptr;
+  }
+  if (!patched) {
+    // The element is changed to the default value.
+    FieldCodec<value_type>::Clear(element);
+  }
+  return p;
+}
+
+// Apply the payload of a record to the field.
+template <class Tp>
+const char* PatchField(Tp* v, const char* p, const char* end) {
+  auto op = PatchOp::REPLACE;
+  while (p < end) {
+    int32_t seq;
+    WireType type;
+    if ((p = ReadTag(p, end, &seq, &type)) == nullptr) {
+      return nullptr;
+    }
+    if (seq == 1 && type == WireType::VARINT) {
+      uint64_t value;
+      if ((p = ReadVarint(p, end, &value)) == nullptr) {
+        return nullptr;
+      }
+      op = static_cast<PatchOp>(value);
+      if (op == PatchOp::REPLACE) {
+        ClearField(v);
+      } else if ((op == PatchOp::PATCH_MESSAGE && !IsMessageV<Tp>) || (op == PatchOp::PATCH_LIST && !IsPatchableListV<Tp>) ||
+                 value > static_cast<uint64_t>(PatchOp::PATCH_LIST)) {
+        return nullptr;
+      }
+    } else if (seq == 2 && op == PatchOp::REPLACE) {
+      p = FieldCodec<Tp>::Read(type, p, end, v);
+    } else if (seq == 2 && op == PatchOp::PATCH_MESSAGE && type == WireType::LENGTH_DELIMITED) {
+      if constexpr (IsMessageV<Tp>) {
+        size_t len;
+        if ((p = ReadLength(p, end, &len)) == nullptr || PatchCodec<Tp>::Apply(v, p, p + len) == nullptr) {
+          return nullptr;
+        }
+        p += len;
+      }
+    } else if (seq == 3 && op == PatchOp::PATCH_LIST && type == WireType::VARINT) {
+      if constexpr (IsPatchableListV<Tp>) {
+        uint64_t size;
+        if ((p = ReadVarint(p, end, &size)) == nullptr || size > v->size() + static_cast<size_t>(end - p)) {
+          return nullptr;
+        }
+        const size_t old_size = v->size();
+        v->resize(size);
+        for (size_t i = old_size; i < v->size(); i++) {
+          ArenaTraits<Tp>::BindElement(*v, (*v)[i]);
+        }
+      }
+    } else if (seq == 4 && op == PatchOp::PATCH_LIST && type == WireType::LENGTH_DELIMITED) {
+      if constexpr (IsPatchableListV<Tp>) {
+        size_t len;
+        if ((p = ReadLength(p, end, &len)) == nullptr || PatchElement(v, p, p + len) == nullptr) {
+          return nullptr;
+        }
+        p += len;
+      }
+    } else {
+      p = SkipField(type, p, end);
+    }
+    if (p == nullptr) {
+      return nullptr;
+    }
+  }
+  return p;
+}
+
+// Dispatch the records of a delta to the fields with the same seq numbers, like MessageBase::FieldsParser.
+template <class Msg>
+struct PatchCodec {
+  using indices_type = decltype(Msg::FieldsIndices::value);
+  static constexpr indices_type indices = Msg::FieldsIndices::value;
+
+  static void Diff(const Msg& old_msg, const Msg& new_msg, std::string* out) {
+    auto old_tuple = old_msg.DumpTuple();
+    auto new_tuple = new_msg.DumpTuple();
+    DiffImpl(old_tuple, new_tuple, out, std::make_index_sequence<indices.size()>{});
+  }
+
+  // The records of the unknown seq numbers are skipped. Return nullptr if the delta is malformed, and the fields which are
+  // patched before are kept.
+  static const char* Apply(Msg* msg, const char* p, const char* end) {
+    using patcher_type = const char* (*)(Msg*, const char*, const char*);
+    static constexpr auto patchers = MakePatchers<patcher_type>(std::make_index_sequence<indices.size()>{});
+    while (p < end) {
+      int32_t seq;
+      WireType type;
+      if ((p = ReadTag(p, end, &seq, &type)) == nullptr) {
+        return nullptr;
+      }
+      const int32_t index = Msg::FieldsParser::Find(seq);
+      if (index < 0 || type != WireType::LENGTH_DELIMITED) {
+        p = SkipField(type, p, end);
+      } else {
+        size_t len;
+        if ((p = ReadLength(p, end, &len)) == nullptr) {
+          return nullptr;
+        }
+        msg->DecodeLazyField(index);
+        p = patchers[index](msg, p, p + len) == nullptr ? nullptr : p + len;
+      }
+      if (p == nullptr) {
+        return nullptr;
+      }
+    }
+    return p;
+  }
+
+ private:
+  template <class Tuple, size_t... I>
+  static void DiffImpl(const Tuple& old_tuple, const Tuple& new_tuple, std::string* out, std::index_sequence<I...>) {
+    (DiffField(indices[I].first, std::get<I>(old_tuple), std::get<I>(new_tuple), out), ...);
+  }
+
+  template <size_t I>
+  static const char* PatchAt(Msg* msg, const char* p, const char* end) {
+    return PatchField(&msg->FIELD_value(int32_constant<indices[I].second>{}), p, end);
+  }
+
+  template <class Patcher, size_t... I>
+  static constexpr std::array<Patcher, sizeof...(I)> MakePatchers(std::index_sequence<I...>) noexcept {
+    return {&PatchAt<I>...};
+  }
+};
+
+}  // namespace internal
+
+// Return the delta from old_msg to new_msg, which is empty if the messages are equal. Only the changed fields are
+// written: an embedded message is diffed recursively, and a list with random access by the indices of the changed
+// elements unless replacing it is smaller. The other fields (e.g., strings and maps) are replaced as a whole.
+template <class Msg, class = std::enable_if_t<IsMessageV<Msg>>>
+[[nodiscard]] std::string Diff(const Msg& old_msg, const Msg& new_msg) {
+  std::string delta;
+  internal::PatchCodec<Msg>::Diff(old_msg, new_msg, &delta);
+  return delta;
+}
+
+// Apply a delta which is made by Diff(old_msg, new_msg) to a message equal to old_msg, then it's equal to new_msg.
+// Return false if the delta is malformed, in which case the message may be partially patched.
+template <class Msg, class = std::enable_if_t<IsMessageV<Msg>>>
+[[nodiscard]] bool ApplyPatch(Msg* msg, std::string_view delta) {
+  return internal::PatchCodec<Msg>::Apply(msg, delta.data(), delta.data() + delta.size()) != nullptr;
+}
+
+}  // namespace liteproto
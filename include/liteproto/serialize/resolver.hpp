@@ -4,17 +4,205 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+#include "liteproto/message.hpp"
 #include "liteproto/reflect.hpp"
 
 namespace liteproto {
 
+// A Resolver walks a value whose type is known at compile time, and pushes the typed events into a Receiver. The
+// traversal is statically dispatched, so a Receiver never inspects the Object or the Kind at runtime. The JSON writer is
+// a Receiver (see WriteJson()). The binary codec doesn't use the Resolver, since a length-delimited record needs the
+// size of its payload before the payload, which a single forward pass of the events cannot provide, so it keeps its own
+// ValueCodec and FieldCodec. A Receiver offers the member functions below, each of which returns false to stop the
+// traversal.
+//
+//   bool OnBool(bool);
+//   bool OnInt64(int64_t);                 // signed integers and the enums whose underlying type is signed
+//   bool OnUInt64(uint64_t);               // unsigned integers and the enums whose underlying type is unsigned
+//   bool OnFloat64(double);                // float and double
+//   bool OnString(std::string_view);       // String and std::string_view
+//   bool BeginList(size_t size);           // followed by the events of each element
+//   bool EndList();
+//   bool BeginMap(size_t size, Kind key);  // followed by the entries, key is the resolved kind of the keys
+//   bool BeginEntry();                     // followed by the events of the key and the value
+//   bool EndEntry();
+//   bool EndMap();
+//   bool BeginPair();                      // followed by the events of first and second
+//   bool EndPair();
+//   bool BeginMessage(size_t size);        // followed by the fields in the order of the seq number
+//   bool OnField(std::string_view name, int32_t seq);  // followed by the events of the field value
+//   bool EndMessage();
+//
+// The resolved kind is one of NUMBER, STRING, LIST, MAP, PAIR and MESSAGE, i.e., which events a value emits.
+
+template <class Tp, class Receiver>
+bool Resolve(const Tp& value, Receiver& receiver);
+
+template <class Tp>
+constexpr Kind ResolvedKind() noexcept {
+  using type = std::remove_cv_t<Tp>;
+  if constexpr (std::is_arithmetic_v<type> || std::is_enum_v<type>) {
+    return Kind::NUMBER;
+  } else if constexpr (IsStringV<type> || std::is_same_v<type, std::string_view>) {
+    return Kind::STRING;
+  } else if constexpr (IsMessageV<type>) {
+    return Kind::MESSAGE;
+  } else if constexpr (IsListV<type>) {
+    return Kind::LIST;
+  } else if constexpr (IsMapV<type>) {
+    return Kind::MAP;
+  } else if constexpr (IsPairV<type>) {
+    return Kind::PAIR;
+  } else {
+    return Kind::VOID;
+  }
+}
+
+template <class Tp>
+class NumberResolver {
+ public:
+  explicit NumberResolver(Tp value) noexcept : value_(value) {}
+
+  template <class Receiver>
+  bool operator()(Receiver& receiver) const {
+    if constexpr (std::is_same_v<Tp, bool>) {
+      return receiver.OnBool(value_);
+    } else if constexpr (std::is_enum_v<Tp>) {
+      return NumberResolver<std::underlying_type_t<Tp>>(static_cast<std::underlying_type_t<Tp>>(value_))(receiver);
+    } else if constexpr (std::is_floating_point_v<Tp>) {
+      return receiver.OnFloat64(static_cast<double>(value_));
+    } else if constexpr (std::is_signed_v<Tp>) {
+      return receiver.OnInt64(static_cast<int64_t>(value_));
+    } else {
+      return receiver.OnUInt64(static_cast<uint64_t>(value_));
+    }
+  }
+
+ private:
+  Tp value_;
+};
+
+template <class Tp>
+class StringResolver {
+ public:
+  explicit StringResolver(const Tp& value) noexcept : value_(value) {}
+
+  template <class Receiver>
+  bool operator()(Receiver& receiver) const {
+    return receiver.OnString(std::string_view{value_.data(), value_.size()});
+  }
+
+ private:
+  const Tp& value_;
+};
+
 template <class Tp>
 class ListResolver {
  public:
+  explicit ListResolver(const Tp& value) noexcept : value_(value) {}
+
   template <class Receiver>
-  Receiver& operator()(Receiver& receiver) const {
+  bool operator()(Receiver& receiver) const {
+    if (!receiver.BeginList(value_.size())) {
+      return false;
+    }
+    for (const auto& element : value_) {
+      if (!Resolve(element, receiver)) {
+        return false;
+      }
+    }
+    return receiver.EndList();
+  }
 
+ private:
+  const Tp& value_;
+};
+
+template <class Tp>
+class MapResolver {
+ public:
+  explicit MapResolver(const Tp& value) noexcept : value_(value) {}
+
+  template <class Receiver>
+  bool operator()(Receiver& receiver) const {
+    if (!receiver.BeginMap(value_.size(), ResolvedKind<typename MapTraits<Tp>::key_type>())) {
+      return false;
+    }
+    for (const auto& [key, value] : value_) {
+      if (!receiver.BeginEntry() || !Resolve(key, receiver) || !Resolve(value, receiver) || !receiver.EndEntry()) {
+        return false;
+      }
+    }
+    return receiver.EndMap();
+  }
+
+ private:
+  const Tp& value_;
+};
+
+template <class Tp>
+class PairResolver {
+ public:
+  explicit PairResolver(const Tp& value) noexcept : value_(value) {}
+
+  template <class Receiver>
+  bool operator()(Receiver& receiver) const {
+    return receiver.BeginPair() && Resolve(value_.first, receiver) && Resolve(value_.second, receiver) && receiver.EndPair();
   }
+
+ private:
+  const Tp& value_;
 };
 
-}  // namespace liteproto
\ No newline at end of file
+template <class Tp>
+class MessageResolver {
+ public:
+  explicit MessageResolver(const Tp& value) noexcept : value_(value) {}
+
+  template <class Receiver>
+  bool operator()(Receiver& receiver) const {
+    constexpr size_t size = Tp::FieldsIndices::value.size();
+    return receiver.BeginMessage(size) && ResolveFields(receiver, std::make_index_sequence<size>{}) && receiver.EndMessage();
+  }
+
+ private:
+  template <class Receiver, size_t... I>
+  bool ResolveFields(Receiver& receiver, std::index_sequence<I...>) const {
+    constexpr auto indices = Tp::FieldsIndices::value;
+    [[maybe_unused]] auto tuple = value_.DumpTuple();
+    return (true && ... &&
+            (receiver.OnField(Tp::FIELD_name(int32_constant<indices[I].second>{}), indices[I].first) &&
+             Resolve(std::get<I>(tuple), receiver)));
+  }
+
+  const Tp& value_;
+};
+
+template <class Tp, class Receiver>
+bool Resolve(const Tp& value, Receiver& receiver) {
+  using type = std::remove_cv_t<Tp>;
+  constexpr Kind kind = ResolvedKind<type>();
+  if constexpr (kind == Kind::NUMBER) {
+    return NumberResolver<type>(value)(receiver);
+  } else if constexpr (kind == Kind::STRING) {
+    return StringResolver<type>(value)(receiver);
+  } else if constexpr (kind == Kind::MESSAGE) {
+    return MessageResolver<type>(value)(receiver);
+  } else if constexpr (kind == Kind::LIST) {
+    return ListResolver<type>(value)(receiver);
+  } else if constexpr (kind == Kind::MAP) {
+    return MapResolver<type>(value)(receiver);
+  } else if constexpr (kind == Kind::PAIR) {
+    return PairResolver<type>(value)(receiver);
+  } else {
+    static_assert(!std::is_same_v<Tp, Tp>, "this type cannot be resolved");
+    return false;
+  }
+}
+
+}  // namespace liteproto
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "liteproto/serialize/wire_format.hpp"
+
+// A stream of messages is a sequence of records, each of which is a varint length followed by a serialized message,
+// i.e., the same framing as the writeDelimitedTo() of protobuf. The stream has no header and no trailer, so the files
+// written by several writers can be simply concatenated. The writer and the reader are based on the POSIX file APIs.
+
+namespace liteproto {
+
+namespace internal {
+
+// Write all the given buffers to fd, retrying on the short writes and EINTR. The iovecs are consumed.
+inline bool WriteFully(int fd, iovec* iov, int count) noexcept {
+  while (count > 0) {
+    ssize_t n = ::writev(fd, iov, count);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    auto written = static_cast<size_t>(n);
+    while (count > 0 && written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
+  }
+  return true;
+}
+
+}  // namespace internal
+
+// MessageWriter batches the records in a buffer and writes the buffer with a single syscall when it is full. A record
+// larger than the buffer is serialized into a scratch buffer and written together with the buffered records by a single
+// writev. The scratch buffer is kept for the next large record, unless it grows beyond kMaxScratchCapacity.
+// The fd is not owned by the writer. The records in the buffer are flushed on the destruction, call Flush() to check
+// the result.
+class MessageWriter {
+ public:
+  static constexpr size_t kDefaultCapacity = 1 << 20;
+  static constexpr size_t kMaxScratchCapacity = 16 << 20;
+
+  explicit MessageWriter(int fd, size_t capacity = kDefaultCapacity)
+      : fd_(fd), capacity_(capacity), buffer_(new char[capacity]) {}
+
+  MessageWriter(const MessageWriter&) = delete;
+  MessageWriter& operator=(const MessageWriter&) = delete;
+
+  ~MessageWriter() { Flush(); }
+
+  // Return false if the writing failed, after which all the writes fail.
+  template <class Msg>
+  bool Write(const Msg& msg) {
+    if (failed_) {
+      return false;
+    }
+    size_t size = msg.ByteSize();
+    size_t record_size = internal::VarintSize(size) + size;
+    if (record_size <= capacity_) {
+      if (record_size > capacity_ - used_ && !Flush()) {
+        return false;
+      }
+      char* p = internal::WriteVarint(size, buffer_.get() + used_);
+      msg.SerializeWithCachedSizesToArray(p);
+      used_ += record_size;
+      return true;
+    }
+    char prefix[internal::kMaxVarintSize];
+    auto prefix_size = static_cast<size_t>(internal::WriteVarint(size, prefix) - prefix);
+    if (size > scratch_capacity_) {
+      scratch_.reset(new char[size]);
+      scratch_capacity_ = size;
+    }
+    msg.SerializeWithCachedSizesToArray(scratch_.get());
+    iovec iov[3] = {{buffer_.get(), used_}, {prefix, prefix_size}, {scratch_.get(), size}};
+    used_ = 0;
+    failed_ = !internal::WriteFully(fd_, iov, 3);
+    if (scratch_capacity_ > kMaxScratchCapacity) {
+      scratch_.reset();
+      scratch_capacity_ = 0;
+    }
+    return !failed_;
+  }
+
+  bool Flush() {
+    if (failed_) {
+      return false;
+    }
+    if (used_ != 0) {
+      iovec iov = {buffer_.get(), used_};
+      used_ = 0;
+      failed_ = !internal::WriteFully(fd_, &iov, 1);
+    }
+    return !failed_;
+  }
+
+  // The size of the records in the buffer which are not written yet.
+  [[nodiscard]] size_t buffered() const noexcept { return used_; }
+
+ private:
+  int fd_;
+  size_t capacity_;
+  size_t used_ = 0;
+  bool failed_ = false;
+  std::unique_ptr<char[]> buffer_;
+  size_t scratch_capacity_ = 0;
+  std::unique_ptr<char[]> scratch_;
+};
+
+// MessageReader hands out the records of a stream as the slices of the input without copying. The input is either a
+// buffer owned by the caller or a file mapped into the memory by Open(). The slices are valid until the reader is
+// closed or destructed, and so are the std::string_view fields of the messages parsed from them.
+class MessageReader {
+ public:
+  MessageReader() noexcept = default;
+  MessageReader(const char* data, size_t size) noexcept : begin_(data), pos_(data), end_(data + size) {}
+
+  MessageReader(const MessageReader&) = delete;
+  MessageReader& operator=(const MessageReader&) = delete;
+
+  ~MessageReader() { Close(); }
+
+  // Map the whole file for reading, return false if the file cannot be opened or mapped.
+  bool Open(const char* path) noexcept {
+    Close();
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    void* addr = nullptr;
+    if (size != 0) {
+      addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping is still valid after the fd is closed.
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      return false;
+    }
+    if (addr != nullptr) {
+      ::madvise(addr, size, MADV_SEQUENTIAL);
+    }
+    mapped_ = addr;
+    mapped_size_ = size;
+    begin_ = pos_ = static_cast<const char*>(addr);
+    end_ = begin_ + size;
+    return true;
+  }
+
+  bool Open(const std::string& path) noexcept { return Open(path.c_str()); }
+
+  void Close() noexcept {
+    if (mapped_ != nullptr) {
+      ::munmap(mapped_, mapped_size_);
+    }
+    mapped_ = nullptr;
+    mapped_size_ = 0;
+    begin_ = pos_ = end_ = nullptr;
+    malformed_ = false;
+  }
+
+  // Return the next record, or false at the end of the stream or if the stream is malformed (see malformed()).
+  bool Next(std::string_view* record) noexcept {
+    if (pos_ == end_ || malformed_) {
+      return false;
+    }
+    size_t len;
+    const char* p = internal::ReadLength(pos_, end_, &len);
+    if (p == nullptr) {
+      malformed_ = true;
+      return false;
+    }
+    *record = std::string_view{p, len};
+    pos_ = p + len;
+    return true;
+  }
+
+  // Parse the next record into msg. A record which cannot be parsed marks the stream as malformed.
+  template <class Msg>
+  bool Next(Msg* msg) {
+    std::string_view record;
+    if (!Next(&record)) {
+      return false;
+    }
+    if (!msg->ParseFromString(record)) {
+      malformed_ = true;
+      return false;
+    }
+    return true;
+  }
+
+  // Return true if the reading stopped at a truncated or unparsable record.
+  [[nodiscard]] bool malformed() const noexcept { return malformed_; }
+  // The offset of the next record.
+  [[nodiscard]] size_t offset() const noexcept { return static_cast<size_t>(pos_ - begin_); }
+  [[nodiscard]] size_t size() const noexcept { return static_cast<size_t>(end_ - begin_); }
+
+ private:
+  void* mapped_ = nullptr;
+  size_t mapped_size_ = 0;
+  const char* begin_ = nullptr;
+  const char* pos_ = nullptr;
+  const char* end_ = nullptr;
+  bool malformed_ = false;
+};
+
+}  // namespace liteproto
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace liteproto {
+
+// The binary format of liteproto is exactly the protobuf wire format. Each field is encoded as a record which starts
+// with a varint tag `(seq << 3) | wire_type`, where the seq is the number given by `Seq<N>` in the field declaration.
+enum class WireType : uint8_t { VARINT = 0, FIXED64 = 1, LENGTH_DELIMITED = 2, START_GROUP = 3, END_GROUP = 4, FIXED32 = 5 };
+
+namespace internal {
+
+inline constexpr size_t kMaxVarintSize = 10;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+inline constexpr bool kLittleEndian = true;
+#else
+inline constexpr bool kLittleEndian = false;
+#endif
+
+constexpr uint32_t MakeTag(int32_t seq, WireType type) noexcept {
+  return (static_cast<uint32_t>(seq) << 3) | static_cast<uint32_t>(type);
+}
+
+constexpr size_t VarintSize(uint64_t v) noexcept {
+  size_t size = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    size++;
+  }
+  return size;
+}
+
+constexpr size_t LengthDelimitedSize(size_t len) noexcept { return VarintSize(len) + len; }
+
+inline char* WriteVarint(uint64_t v, char* p) noexcept {
+  while (v >= 0x80) {
+    *p++ = static_cast<char>(static_cast<uint8_t>(v) | 0x80);
+    v >>= 7;
+  }
+  *p++ = static_cast<char>(v);
+  return p;
+}
+
+// The fixed-width values are always little endian on the wire. The shifts are recognized by the compilers and will be
+// lowered to a single store on the little endian machines.
+inline char* WriteFixed32(uint32_t v, char* p) noexcept {
+  for (int i = 0; i < 4; i++) {
+    p[i] = static_cast<char>(static_cast<uint8_t>(v >> (i * 8)));
+  }
+  return p + 4;
+}
+
+inline char* WriteFixed64(uint64_t v, char* p) noexcept {
+  for (int i = 0; i < 8; i++) {
+    p[i] = static_cast<char>(static_cast<uint8_t>(v >> (i * 8)));
+  }
+  return p + 8;
+}
+
+inline char* WriteBytes(const void* data, size_t n, char* p) noexcept {
+  if (n != 0) {
+    std::memcpy(p, data, n);
+  }
+  return p + n;
+}
+
+// All the Read functions return the position next to the parsed value, or nullptr if the input is malformed.
+
+inline const char* ReadVarint(const char* p, const char* end, uint64_t* v) noexcept {
+  if (p < end && static_cast<uint8_t>(*p) < 0x80) {
+    *v = static_cast<uint8_t>(*p);
+    return p + 1;
+  }
+  uint64_t result = 0;
+  for (uint32_t shift = 0; shift < 64 && p < end; shift += 7) {
+    uint64_t byte = static_cast<uint8_t>(*p++);
+    result |= (byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      *v = result;
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+inline const char* ReadFixed32(const char* p, const char* end, uint32_t* v) noexcept {
+  if (end - p < 4) {
+    return nullptr;
+  }
+  uint32_t result = 0;
+  for (int i = 0; i < 4; i++) {
+    result |= static_cast<uint32_t>(static_cast<uint8_t>(p[i])) << (i * 8);
+  }
+  *v = result;
+  return p + 4;
+}
+
+inline const char* ReadFixed64(const char* p, const char* end, uint64_t* v) noexcept {
+  if (end - p < 8) {
+    return nullptr;
+  }
+  uint64_t result = 0;
+  for (int i = 0; i < 8; i++) {
+    result |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (i * 8);
+  }
+  *v = result;
+  return p + 8;
+}
+
+// Read the length prefix of a length-delimited record, and make sure that the whole payload is inside the input.
+inline const char* ReadLength(const char* p, const char* end, size_t* len) noexcept {
+  uint64_t v = 0;
+  p = ReadVarint(p, end, &v);
+  if (p == nullptr || v > static_cast<uint64_t>(end - p)) {
+    return nullptr;
+  }
+  *len = static_cast<size_t>(v);
+  return p;
+}
+
+inline const char* ReadTag(const char* p, const char* end, int32_t* seq, WireType* type) noexcept {
+  uint64_t tag = 0;
+  p = ReadVarint(p, end, &tag);
+  if (p == nullptr || (tag >> 3) == 0 || tag > 0xffffffffu) {
+    return nullptr;
+  }
+  *seq = static_cast<int32_t>(tag >> 3);
+  *type = static_cast<WireType>(tag & 7);
+  return p;
+}
+
+// Skip the payload of a record, for the unknown fields or the known fields with a mismatched wire type.
+inline const char* SkipField(WireType type, const char* p, const char* end) noexcept {
+  switch (type) {
+    case WireType::VARINT: {
+      uint64_t v;
+      return ReadVarint(p, end, &v);
+    }
+    case WireType::FIXED64:
+      return end - p < 8 ? nullptr : p + 8;
+    case WireType::LENGTH_DELIMITED: {
+      size_t len;
+      p = ReadLength(p, end, &len);
+      return p == nullptr ? nullptr : p + len;
+    }
+    case WireType::FIXED32:
+      return end - p < 4 ? nullptr : p + 4;
+    default:
+      // groups are deprecated and not supported.
+      return nullptr;
+  }
+}
+
+}  // namespace internal
+
+}  // namespace liteproto
@@ -52,6 +52,24 @@ auto HasCapacity(int) -> std::true_type;
 template <class>
 auto HasCapacity(float) -> std::false_type;
 
+template <class C, class = decltype(std::declval<C&>().reserve(std::declval<size_t>()))>
+auto HasReserve(int) -> std::true_type;
+
+template <class>
+auto HasReserve(float) -> std::false_type;
+
+template <class C, class = decltype(std::declval<C&>().shrink_to_fit())>
+auto HasShrinkToFit(int) -> std::true_type;
+
+template <class>
+auto HasShrinkToFit(float) -> std::false_type;
+
+template <class C, class = decltype(std::declval<C&>().rehash(std::declval<size_t>()))>
+auto HasRehash(int) -> std::true_type;
+
+template <class>
+auto HasRehash(float) -> std::false_type;
+
 template <class C, class = std::enable_if_t<std::is_convertible_v<std::invoke_result_t<decltype(&C::empty), const C>, bool>>>
 auto HasEmpty(int) -> std::true_type;
 
@@ -204,6 +222,24 @@ struct has_capacity : decltype(details::HasCapacity<C>(0)) {};
 template <class C>
 inline constexpr bool has_capacity_v = has_capacity<C>::value;
 
+template <class C>
+struct has_reserve : decltype(details::HasReserve<C>(0)) {};
+
+template <class C>
+inline constexpr bool has_reserve_v = has_reserve<C>::value;
+
+template <class C>
+struct has_shrink_to_fit : decltype(details::HasShrinkToFit<C>(0)) {};
+
+template <class C>
+inline constexpr bool has_shrink_to_fit_v = has_shrink_to_fit<C>::value;
+
+template <class C>
+struct has_rehash : decltype(details::HasRehash<C>(0)) {};
+
+template <class C>
+inline constexpr bool has_rehash_v = has_rehash<C>::value;
+
 template <class C>
 struct has_empty : decltype(details::HasEmpty<C>(0)) {};
 
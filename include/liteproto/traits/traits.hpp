@@ -23,6 +23,7 @@ namespace liteproto {
 
 class Object;
 class Number;
+class Message;
 
 enum class ConstOption : bool { NON_CONST = false, CONST = true };
 
@@ -336,6 +337,16 @@ struct IsPair<Pair, std::void_t<typename PairTraits<Pair>::value_type>> : std::t
 template <class Pair>
 inline constexpr bool IsPairV = IsPair<Pair>::value;
 
+// A Message is any class that derives from liteproto::Message, i.e., the classes defined by MESSAGE or TEMPLATE_MESSAGE.
+template <class Tp, class Cond = void>
+struct IsMessage : std::false_type {};
+
+template <class Tp>
+struct IsMessage<Tp, std::enable_if_t<std::is_class_v<Tp> && std::is_base_of_v<Message, std::remove_cv_t<Tp>>>> : std::true_type {};
+
+template <class Tp>
+inline constexpr bool IsMessageV = IsMessage<Tp>::value;
+
 // All the indirect type should be proxied by Object when reflecting.
 
 template <class Tp, class = void>
@@ -381,4 +392,21 @@ struct IsNumberType : std::negation<IsIndirectType<Tp>> {};
 template <class Tp>
 inline constexpr bool IsNumberTypeV = IsNumberType<Tp>::value;
 
+namespace internal {
+
+// The hook through which the decoders bind the values they add to a container of type Tp to the arena of the container.
+// It does nothing, unless liteproto/arena.hpp, which specializes it for the std::pmr containers, is included. So the
+// arena and <memory_resource> are opt-in, and the decoders never depend on them.
+template <class Tp, class = void>
+struct ArenaTraits {
+  // Bind a value which is decoded aside and then moved into the container, e.g., the key of a map entry.
+  template <class Value>
+  static void Bind(const Tp&, Value&) noexcept {}
+  // Bind an element which is constructed in the container.
+  template <class Element>
+  static void BindElement(const Tp&, Element&) noexcept {}
+};
+
+}  // namespace internal
+
 }  // namespace liteproto
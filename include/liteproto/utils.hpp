@@ -5,6 +5,8 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <variant>
@@ -155,6 +157,202 @@ constexpr decltype(auto) GetAllFields2() {
   return final;
 }
 
+// The seq numbers are looked up through a table indexed by the seq number if they are dense enough, otherwise through
+// binary search over the sorted indices. SeqTableSize() returns 0 for the latter.
+template <size_t N>
+constexpr size_t SeqTableSize(const std::array<PII, N>& indices) {
+  if constexpr (N == 0) {
+    return 0;
+  } else {
+    const auto max_seq = static_cast<size_t>(indices[N - 1].first);
+    return max_seq <= N * 2 + 16 ? max_seq + 1 : 0;
+  }
+}
+
+template <size_t Size, size_t N>
+constexpr auto MakeSeqTable(const std::array<PII, N>& indices) {
+  std::array<int32_t, Size> table{};
+  for (size_t i = 0; i < Size; i++) {
+    table[i] = -1;
+  }
+  if constexpr (Size != 0) {
+    for (size_t i = 0; i < N; i++) {
+      table[indices[i].first] = static_cast<int32_t>(i);
+    }
+  }
+  return table;
+}
+
+// Return the position of the field with the given seq number in the sorted indices, or -1 if there is no such field.
+template <size_t N>
+constexpr int32_t BinarySearchSeq(const std::array<PII, N>& indices, int32_t seq) {
+  size_t l = 0, r = N;
+  while (l < r) {
+    size_t mid = l + (r - l) / 2;
+    if (indices[mid].first < seq) {
+      l = mid + 1;
+    } else {
+      r = mid;
+    }
+  }
+  return l < N && indices[l].first == seq ? static_cast<int32_t>(l) : -1;
+}
+
+// A perfect hash over a set of distinct strings which are known at compile time, e.g., the field names. The hash is a
+// seeded FNV-1a. FindPerfectHash() tries a few seeds at a table size of 2x and 4x the number of keys, and returns a size
+// of 0 if none of them is collision free. The search is bounded since it runs for every message in every translation
+// unit, and the names fall back to a SortedStringTable. A lookup takes one hash and one string comparison.
+constexpr uint32_t HashString(std::string_view str, uint32_t seed) noexcept {
+  uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+  for (char c : str) {
+    h ^= static_cast<uint8_t>(c);
+    h *= 16777619u;
+  }
+  return h ^ (h >> 15);
+}
+
+struct PerfectHashParams {
+  size_t size;
+  uint32_t seed;
+};
+
+inline constexpr uint32_t kPerfectHashSeeds = 32;
+
+template <size_t Size, size_t N>
+constexpr bool IsPerfectHash(const std::array<std::string_view, N>& keys, uint32_t seed) noexcept {
+  std::array<bool, Size> used{};
+  for (size_t i = 0; i < N; i++) {
+    size_t slot = HashString(keys[i], seed) & (Size - 1);
+    if (used[slot]) {
+      return false;
+    }
+    used[slot] = true;
+  }
+  return true;
+}
+
+template <size_t Size, size_t N>
+constexpr PerfectHashParams FindPerfectHashOfSize(const std::array<std::string_view, N>& keys) noexcept {
+  for (uint32_t seed = 0; seed < kPerfectHashSeeds; seed++) {
+    if (IsPerfectHash<Size>(keys, seed)) {
+      return PerfectHashParams{Size, seed};
+    }
+  }
+  return PerfectHashParams{0, 0};
+}
+
+constexpr size_t CeilPowerOf2(size_t n) noexcept {
+  size_t size = 1;
+  while (size < n) {
+    size *= 2;
+  }
+  return size;
+}
+
+template <size_t N>
+constexpr PerfectHashParams FindPerfectHash(const std::array<std::string_view, N>& keys) noexcept {
+  constexpr size_t size = CeilPowerOf2(2 * N);
+  if (auto params = FindPerfectHashOfSize<size>(keys); params.size != 0) {
+    return params;
+  }
+  return FindPerfectHashOfSize<2 * size>(keys);
+}
+
+template <size_t N, size_t Size>
+class PerfectHashTable {
+  static_assert(Size != 0 || N == 0, "no perfect hash is found for the keys, use MakeStringTable() for a fallback");
+
+ public:
+  constexpr PerfectHashTable(const std::array<std::string_view, N>& keys, uint32_t seed) noexcept
+      : keys_(keys), slots_{}, seed_(seed) {
+    for (size_t i = 0; i < Size; i++) {
+      slots_[i] = -1;
+    }
+    for (size_t i = 0; i < N; i++) {
+      slots_[HashString(keys[i], seed) & (Size - 1)] = static_cast<int32_t>(i);
+    }
+  }
+
+  // Return the position of the key in the given keys, or -1 if it is not one of the keys.
+  [[nodiscard]] constexpr int32_t Find(std::string_view key) const noexcept {
+    if constexpr (Size == 0) {
+      return -1;
+    } else {
+      int32_t index = slots_[HashString(key, seed_) & (Size - 1)];
+      return index >= 0 && keys_[index] == key ? index : -1;
+    }
+  }
+
+ private:
+  std::array<std::string_view, N> keys_;
+  std::array<int32_t, Size> slots_;
+  uint32_t seed_;
+};
+
+// The keys sorted at compile time, which is the fallback of PerfectHashTable if FindPerfectHash() fails within its
+// bounded search (e.g., for more than a few dozen keys). A lookup is a binary search, like BinarySearchSeq().
+template <size_t N>
+class SortedStringTable {
+ public:
+  constexpr explicit SortedStringTable(const std::array<std::string_view, N>& keys) noexcept : entries_{} {
+    // Insertion sort, since std::sort is not constexpr.
+    for (size_t i = 0; i < N; i++) {
+      Entry entry{keys[i], static_cast<int32_t>(i)};
+      size_t j = i;
+      for (; j > 0 && entry.key < entries_[j - 1].key; j--) {
+        entries_[j] = entries_[j - 1];
+      }
+      entries_[j] = entry;
+    }
+  }
+
+  [[nodiscard]] constexpr bool HasDuplicates() const noexcept {
+    for (size_t i = 1; i < N; i++) {
+      if (entries_[i - 1].key == entries_[i].key) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Return the position of the key in the given keys, or -1 if it is not one of the keys.
+  [[nodiscard]] constexpr int32_t Find(std::string_view key) const noexcept {
+    size_t l = 0, r = N;
+    while (l < r) {
+      size_t mid = l + (r - l) / 2;
+      if (entries_[mid].key < key) {
+        l = mid + 1;
+      } else {
+        r = mid;
+      }
+    }
+    return l < N && entries_[l].key == key ? entries_[l].index : -1;
+  }
+
+ private:
+  struct Entry {
+    std::string_view key;
+    int32_t index;
+  };
+
+  std::array<Entry, N> entries_;
+};
+
+template <size_t N>
+constexpr bool HasDuplicateKeys(const std::array<std::string_view, N>& keys) noexcept {
+  return SortedStringTable<N>(keys).HasDuplicates();
+}
+
+// Return a PerfectHashTable over the distinct keys if FindPerfectHash() finds one, otherwise a SortedStringTable.
+template <size_t N, size_t Size>
+constexpr auto MakeStringTable(const std::array<std::string_view, N>& keys, uint32_t seed) noexcept {
+  if constexpr (Size != 0 || N == 0) {
+    return PerfectHashTable<N, Size>(keys, seed);
+  } else {
+    return SortedStringTable<N>(keys);
+  }
+}
+
 }  // namespace internal
 
 }  // namespace liteproto
\ No newline at end of file
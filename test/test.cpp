@@ -10,12 +10,12 @@
 
 #include "gtest/gtest.h"
 #include "liteproto/liteproto.hpp"
+#include "liteproto/serialize/json.hpp"
+#include "liteproto/serialize/stream.hpp"
 #include "liteproto/static_test/static_test.hpp"
 #include "nameof.hpp"
 #include "rapidjson/document.h"
 #include "rapidjson/prettywriter.h"
-#include "rapidjson/stringbuffer.h"
-#include "rapidjson/writer.h"
 
 TEST(TestUtils, Sort) {
   using pii = std::pair<int, int>;
@@ -620,3 +620,1227 @@ TEST(Test3rd, RapidJson) {
   document.Accept(writer);
   std::cout << buffer.GetString();
 }
+
+MESSAGE(WireInner) {
+  int FIELD(id)->Seq<1>;
+  std::string FIELD(name)->Seq<2>;
+
+  WireInner() : id_(0) {}
+};
+
+MESSAGE(WireMessage) {
+  int FIELD(i32)->Seq<1>;
+  int64_t FIELD(i64)->Seq<2>;
+  bool FIELD(flag)->Seq<3>;
+  double FIELD(f64)->Seq<4>;
+  float FIELD(f32)->Seq<5>;
+  std::string FIELD(str)->Seq<6>;
+  WireInner FIELD(inner)->Seq<7>;
+  std::vector<std::string> FIELD(strs)->Seq<8>;
+  std::map<int, std::string> FIELD(dict)->Seq<9>;
+  std::vector<WireInner> FIELD(inners)->Seq<16>;
+
+  WireMessage() : i32_(0), i64_(0), flag_(false), f64_(0), f32_(0) {}
+};
+
+TEST(TestSerialize, Encode) {
+  WireMessage msg;
+  // All fields hold the default value, only the embedded message is written.
+  EXPECT_EQ(std::string("\x3a\x00", 2), msg.SerializeAsString());
+  msg.set_i32(150);
+  msg.set_i64(-1);
+  msg.set_flag(true);
+  msg.set_f64(1.0);
+  msg.set_f32(1.0f);
+  msg.set_str("testing");
+  msg.mutable_inner().set_id(150);
+  msg.mutable_strs() = {"a", ""};
+  msg.mutable_dict()[1] = "x";
+  msg.mutable_inners().emplace_back().set_name("y");
+
+  const char raw[] =
+      "\x08\x96\x01"                                  // i32
+      "\x10\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01"  // i64
+      "\x18\x01"                                      // flag
+      "\x21\x00\x00\x00\x00\x00\x00\xf0\x3f"          // f64
+      "\x2d\x00\x00\x80\x3f"                          // f32
+      "\x32\x07testing"                               // str
+      "\x3a\x03\x08\x96\x01"                          // inner
+      "\x42\x01\x61\x42\x00"                          // strs
+      "\x4a\x05\x08\x01\x12\x01x"                     // dict
+      "\x82\x01\x03\x12\x01y";                        // inners
+  const std::string expected{raw, sizeof(raw) - 1};
+  auto bytes = msg.SerializeAsString();
+  EXPECT_EQ(expected, bytes);
+
+  std::string out;
+  EXPECT_TRUE(msg.SerializeToString(&out));
+  EXPECT_EQ(expected, out);
+
+  char buf[64];
+  EXPECT_FALSE(msg.SerializeToArray(buf, expected.size() - 1));
+  EXPECT_TRUE(msg.SerializeToArray(buf, sizeof buf));
+  EXPECT_EQ(expected, std::string(buf, expected.size()));
+}
+
+MESSAGE(WireView) {
+  std::string_view FIELD(name)->Seq<2>;
+  std::vector<std::string_view> FIELD(tags)->Seq<1000>;
+  uint32_t FIELD(id)->Seq<100000>;
+
+  WireView() : id_(0) {}
+};
+
+TEST(TestSerialize, Decode) {
+  WireMessage msg;
+  msg.set_i32(-150);
+  msg.set_i64(1LL << 40);
+  msg.set_flag(true);
+  msg.set_f64(-2.5);
+  msg.set_f32(0.5f);
+  msg.set_str("testing");
+  msg.mutable_inner().set_id(7);
+  msg.mutable_strs() = {"a", "", "bc"};
+  msg.mutable_dict() = {{1, "x"}, {-2, "yz"}};
+  msg.mutable_inners().emplace_back().set_name("y");
+  msg.mutable_inners().emplace_back().set_id(3);
+  auto bytes = msg.SerializeAsString();
+
+  WireMessage parsed;
+  parsed.mutable_strs() = {"stale"};
+  ASSERT_TRUE(parsed.ParseFromString(bytes));
+  EXPECT_EQ(msg.i32(), parsed.i32());
+  EXPECT_EQ(msg.i64(), parsed.i64());
+  EXPECT_EQ(msg.flag(), parsed.flag());
+  EXPECT_EQ(msg.f64(), parsed.f64());
+  EXPECT_EQ(msg.f32(), parsed.f32());
+  EXPECT_EQ(msg.str(), parsed.str());
+  EXPECT_EQ(7, parsed.inner().id());
+  EXPECT_EQ(msg.strs(), parsed.strs());
+  EXPECT_EQ(msg.dict(), parsed.dict());
+  ASSERT_EQ(2, parsed.inners().size());
+  EXPECT_EQ("y", parsed.inners()[0].name());
+  EXPECT_EQ(3, parsed.inners()[1].id());
+  EXPECT_EQ(bytes, parsed.SerializeAsString());
+
+  // Merging appends the repeated fields.
+  EXPECT_TRUE(parsed.MergeFromArray(bytes.data(), bytes.size()));
+  EXPECT_EQ(6, parsed.strs().size());
+  EXPECT_EQ(4, parsed.inners().size());
+
+  // Truncated input.
+  EXPECT_FALSE(parsed.ParseFromArray(bytes.data(), bytes.size() - 1));
+
+  WireView view;
+  view.set_name("name");
+  view.mutable_tags() = {"t1", "t2"};
+  view.set_id(42);
+  // An unknown field and a field with a mismatched wire type are skipped.
+  auto view_bytes = view.SerializeAsString() + std::string("\x18\x05\x10\x05", 4);
+  WireView view_parsed;
+  ASSERT_TRUE(view_parsed.ParseFromString(view_bytes));
+  EXPECT_EQ("name", view_parsed.name());
+  EXPECT_GE(view_parsed.name().data(), view_bytes.data());
+  EXPECT_LT(view_parsed.name().data(), view_bytes.data() + view_bytes.size());
+  ASSERT_EQ(2, view_parsed.tags().size());
+  EXPECT_EQ("t2", view_parsed.tags()[1]);
+  EXPECT_EQ(42, view_parsed.id());
+}
+
+TEST(TestJson, Write) {
+  WireMessage msg;
+  msg.set_i32(-150);
+  msg.set_flag(true);
+  msg.set_f64(0.5);
+  msg.set_f32(0.25f);
+  msg.set_str("a\"b");
+  msg.mutable_inner().set_id(7);
+  msg.mutable_strs() = {"x", "y"};
+  msg.mutable_dict() = {{-1, "m"}, {2, "n"}};
+  msg.mutable_inners().emplace_back().set_name("z");
+
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  ASSERT_TRUE(liteproto::ToJson(msg, writer));
+  const std::string expected =
+      R"({"i32":-150,"i64":0,"flag":true,"f64":0.5,"f32":0.25,"str":"a\"b","inner":{"id":7,"name":""},"strs":["x","y"],)"
+      R"("dict":{"-1":"m","2":"n"},"inners":[{"id":0,"name":"z"}]})";
+  EXPECT_EQ(expected, buffer.GetString());
+
+  std::string output;
+  ASSERT_TRUE(liteproto::ToJsonString(msg, &output));
+  EXPECT_EQ(expected, output);
+
+  std::map<std::pair<int, int>, std::vector<std::pair<int, bool>>> complex{{{1, 2}, {{3, true}}}};
+  rapidjson::StringBuffer complex_buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> complex_writer(complex_buffer);
+  ASSERT_TRUE(liteproto::internal::WriteJson(complex_writer, complex));
+  EXPECT_EQ(std::string("[[[1,2],[[3,true]]]]"), complex_buffer.GetString());
+}
+
+TEST(TestJson, Read) {
+  WireMessage msg;
+  msg.set_i32(-150);
+  msg.set_i64(1LL << 40);
+  msg.set_flag(true);
+  msg.set_f64(0.5);
+  msg.set_str("a\"b");
+  msg.mutable_inner().set_id(7);
+  msg.mutable_strs() = {"x", "y"};
+  msg.mutable_dict() = {{-1, "m"}, {2, "n"}};
+  msg.mutable_inners().emplace_back().set_name("z");
+  std::string json;
+  ASSERT_TRUE(liteproto::ToJsonString(msg, &json));
+
+  WireMessage parsed;
+  parsed.mutable_strs() = {"stale"};
+  ASSERT_TRUE(liteproto::FromJson(json, &parsed));
+  EXPECT_EQ(msg.SerializeAsString(), parsed.SerializeAsString());
+
+  // The unknown fields are skipped, no matter how deep they are.
+  ASSERT_TRUE(liteproto::FromJson(R"({"unknown":{"a":[1,{"b":null}]},"i32":3,"strs":[],"dict":{"5":"v"}})", &parsed));
+  EXPECT_EQ(3, parsed.i32());
+  EXPECT_TRUE(parsed.strs().empty());
+  EXPECT_EQ((std::map<int, std::string>{{5, "v"}}), parsed.dict());
+
+  EXPECT_FALSE(liteproto::FromJson(R"({"i32":"3"})", &parsed));
+  EXPECT_FALSE(liteproto::FromJson(R"({"i32":3000000000})", &parsed));
+  EXPECT_FALSE(liteproto::FromJson(R"({"dict":{"x":"v"}})", &parsed));
+  EXPECT_FALSE(liteproto::FromJson(R"([])", &parsed));
+
+  // The string_view fields point into the input when parsing in situ.
+  char buf[] = R"({"name":"abc","tags":["t1"],"id":7})";
+  WireView view;
+  ASSERT_TRUE(liteproto::FromJsonInsitu(buf, &view));
+  EXPECT_EQ("abc", view.name());
+  EXPECT_GE(view.name().data(), buf);
+  EXPECT_LT(view.name().data(), buf + sizeof buf);
+  EXPECT_EQ(std::vector<std::string_view>{"t1"}, view.tags());
+  EXPECT_EQ(7, view.id());
+  EXPECT_FALSE(liteproto::FromJson(R"({"name":"abc"})", &view));
+
+  constexpr std::array<std::string_view, 3> keys{"foo", "bar", "baz"};
+  constexpr auto params = liteproto::internal::FindPerfectHash(keys);
+  constexpr liteproto::internal::PerfectHashTable<keys.size(), params.size> table(keys, params.seed);
+  static_assert(table.Find("bar") == 1);
+  static_assert(table.Find("qux") == -1);
+  // The fallback when no perfect hash is found, which is never the case for the duplicate keys.
+  constexpr liteproto::internal::SortedStringTable<keys.size()> sorted(keys);
+  static_assert(sorted.Find("foo") == 0 && sorted.Find("baz") == 2 && sorted.Find("qux") == -1);
+  static_assert(!liteproto::internal::HasDuplicateKeys(keys));
+  constexpr std::array<std::string_view, 3> duplicate_keys{"foo", "bar", "foo"};
+  static_assert(liteproto::internal::FindPerfectHash(duplicate_keys).size == 0);
+  static_assert(liteproto::internal::HasDuplicateKeys(duplicate_keys));
+}
+
+namespace {
+
+// Record the events as a compact trace.
+struct TraceReceiver {
+  bool OnBool(bool v) { return Append(v ? "T" : "F"); }
+  bool OnInt64(int64_t v) { return Append("i" + std::to_string(v)); }
+  bool OnUInt64(uint64_t v) { return Append("u" + std::to_string(v)); }
+  bool OnFloat64(double v) { return Append("f" + std::to_string(static_cast<int>(v))); }
+  bool OnString(std::string_view v) { return Append("'" + std::string(v) + "'"); }
+  bool BeginList(size_t size) { return Append("[" + std::to_string(size)); }
+  bool EndList() { return Append("]"); }
+  bool BeginMap(size_t size, liteproto::Kind key) {
+    return Append("{" + std::to_string(size) + (key == liteproto::Kind::NUMBER ? "n" : "?"));
+  }
+  bool BeginEntry() { return Append("<"); }
+  bool EndEntry() { return Append(">"); }
+  bool EndMap() { return Append("}"); }
+  bool BeginPair() { return Append("("); }
+  bool EndPair() { return Append(")"); }
+  bool BeginMessage(size_t size) { return Append("M" + std::to_string(size)); }
+  bool OnField(std::string_view name, int32_t seq) { return Append(std::string(name) + "@" + std::to_string(seq)); }
+  bool EndMessage() { return Append("E"); }
+
+  bool Append(const std::string& event) {
+    trace += event + " ";
+    return trace.size() < limit;
+  }
+
+  std::string trace;
+  size_t limit = -1;
+};
+
+}  // namespace
+
+TEST(TestResolver, Events) {
+  WireInner inner;
+  inner.set_id(3);
+  inner.set_name("n");
+  TraceReceiver receiver;
+  ASSERT_TRUE(liteproto::Resolve(inner, receiver));
+  EXPECT_EQ("M2 id@1 i3 name@2 'n' E ", receiver.trace);
+
+  std::map<uint8_t, std::vector<std::pair<float, bool>>> map{{1, {{2.0f, true}}}};
+  receiver.trace.clear();
+  ASSERT_TRUE(liteproto::Resolve(map, receiver));
+  EXPECT_EQ("{1n < u1 [1 ( f2 T ) ] > } ", receiver.trace);
+
+  // A receiver stops the traversal by returning false.
+  receiver.trace.clear();
+  receiver.limit = 8;
+  EXPECT_FALSE(liteproto::Resolve(map, receiver));
+  EXPECT_EQ("{1n < u1 ", receiver.trace);
+}
+
+MESSAGE(WirePacked) {
+  std::vector<int32_t> FIELD(i32s)->Seq<1>;
+  std::deque<int64_t> FIELD(i64s)->Seq<2>;
+  std::vector<uint32_t> FIELD(u32s)->Seq<3>;
+  std::vector<double> FIELD(f64s)->Seq<4>;
+  std::deque<bool> FIELD(flags)->Seq<5>;
+  std::list<float> FIELD(f32s)->Seq<6>;
+  std::vector<uint64_t> FIELD(u64s)->Seq<7>;
+};
+
+TEST(TestSerialize, Packed) {
+  WirePacked msg;
+  msg.mutable_i32s() = {3, 270, -1};
+  msg.mutable_flags() = {true, false};
+  msg.mutable_f64s() = {1.0};
+  const char raw[] =
+      "\x0a\x0d\x03\x8e\x02\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01"  // i32s
+      "\x22\x08\x00\x00\x00\x00\x00\x00\xf0\x3f"                      // f64s
+      "\x2a\x02\x01\x00";                                             // flags
+  EXPECT_EQ(std::string(raw, sizeof(raw) - 1), msg.SerializeAsString());
+
+  // Long lists with small and large values go through both the block and the scalar paths.
+  std::mt19937_64 rng(42);
+  for (int i = 0; i < 1000; i++) {
+    auto r = rng();
+    auto small = static_cast<int>(r % 128);
+    bool big = r % 7 == 0;
+    msg.mutable_i32s().push_back(big ? static_cast<int32_t>(r >> 20) : small);
+    msg.mutable_i64s().push_back(big ? static_cast<int64_t>(r) : small);
+    msg.mutable_u32s().push_back(big ? static_cast<uint32_t>(r >> 16) : small);
+    msg.mutable_u64s().push_back(big ? r : small);
+    msg.mutable_f64s().push_back(static_cast<double>(r));
+    msg.mutable_flags().push_back(big);
+    msg.mutable_f32s().push_back(static_cast<float>(small));
+  }
+  auto bytes = msg.SerializeAsString();
+  WirePacked parsed;
+  ASSERT_TRUE(parsed.ParseFromString(bytes));
+  EXPECT_EQ(msg.i32s(), parsed.i32s());
+  EXPECT_EQ(msg.i64s(), parsed.i64s());
+  EXPECT_EQ(msg.u32s(), parsed.u32s());
+  EXPECT_EQ(msg.u64s(), parsed.u64s());
+  EXPECT_EQ(msg.f64s(), parsed.f64s());
+  EXPECT_EQ(msg.flags(), parsed.flags());
+  EXPECT_EQ(msg.f32s(), parsed.f32s());
+  EXPECT_EQ(bytes, parsed.SerializeAsString());
+
+  // The unpacked records are accepted too, and a truncated varint in the packed payload is rejected.
+  ASSERT_TRUE(parsed.ParseFromString(std::string("\x08\x05\x08\x06\x0a\x01\x07", 7)));
+  EXPECT_EQ((std::vector<int32_t>{5, 6, 7}), parsed.i32s());
+  EXPECT_FALSE(parsed.ParseFromString(std::string("\x0a\x02\x01\x80", 4)));
+}
+
+template <class Tp>
+void CheckPackedKernels(const std::vector<Tp>& values) {
+  using Codec = liteproto::internal::ValueCodec<Tp>;
+  std::string expected;
+  for (Tp v : values) {
+    char buf[liteproto::internal::kMaxVarintSize];
+    expected.append(buf, liteproto::internal::WriteVarint(Codec::ToWire(v), buf));
+  }
+  EXPECT_EQ(expected.size(), liteproto::internal::PackedVarintSize<Codec>(values.data(), values.size()));
+  std::string encoded(expected.size(), '\0');
+  char* end = liteproto::internal::EncodePackedVarints<Codec>(values.data(), values.size(), encoded.data());
+  EXPECT_EQ(encoded.data() + encoded.size(), end);
+  EXPECT_EQ(expected, encoded);
+  const char* first = encoded.data();
+  const char* last = first + encoded.size();
+  EXPECT_EQ(values.size(), liteproto::internal::CountVarints(first, last));
+  std::vector<Tp> decoded(values.size());
+  EXPECT_EQ(last, (liteproto::internal::DecodePackedVarints<Codec>(first, last, decoded.data(), decoded.size())));
+  EXPECT_EQ(values, decoded);
+}
+
+// The kernels are checked against the scalar varint codec around the 4/8/16/32 element blocks, with all the elements
+// small (the SIMD fast paths), and with a large element at each position (the fallbacks). The AVX2 kernels are only
+// covered if the test is built with -mavx2 (LITE_PROTO_ENABLE_AVX2).
+TEST(TestSerialize, PackedKernels) {
+  std::mt19937_64 rng(7);
+  for (size_t n = 0; n <= 70; n++) {
+    for (size_t big = 0; big <= n; big++) {
+      std::vector<int32_t> i32s(n);
+      std::vector<uint32_t> u32s(n);
+      std::vector<int64_t> i64s(n);
+      std::vector<uint64_t> u64s(n);
+      for (size_t i = 0; i < n; i++) {
+        auto r = rng();
+        bool large = i == big;
+        i32s[i] = large ? static_cast<int32_t>(r) : static_cast<int32_t>(r % 128);
+        u32s[i] = large ? static_cast<uint32_t>(r >> 8) | 0x80 : static_cast<uint32_t>(r % 128);
+        i64s[i] = large ? static_cast<int64_t>(r) : static_cast<int64_t>(r % 128);
+        u64s[i] = large ? r | 0x80 : r % 128;
+      }
+      CheckPackedKernels(i32s);
+      CheckPackedKernels(u32s);
+      CheckPackedKernels(i64s);
+      CheckPackedKernels(u64s);
+    }
+  }
+  EXPECT_EQ(0, liteproto::internal::PopCount32(0));
+  EXPECT_EQ(32, liteproto::internal::PopCount32(~uint32_t{0}));
+  EXPECT_EQ(0, liteproto::internal::CountTrailingZeros32(1));
+  EXPECT_EQ(31, liteproto::internal::CountTrailingZeros32(uint32_t{1} << 31));
+}
+
+TEST(TestSerialize, ByteSize) {
+  WireMessage msg;
+  EXPECT_EQ(0u, WireInner().ByteSize());
+  msg.set_str(std::string(200, 'x'));
+  msg.mutable_inner().set_name(std::string(300, 'y'));
+  for (int i = 0; i < 3; i++) {
+    msg.mutable_inners().emplace_back().set_id(i + 1);
+  }
+  msg.mutable_dict()[1] = "one";
+
+  size_t size = msg.ByteSize();
+  EXPECT_EQ(size, msg.GetCachedSize());
+  // The sizes of the embedded messages are cached by the same pass.
+  EXPECT_EQ(msg.inner().ByteSize(), msg.inner().GetCachedSize());
+  EXPECT_EQ(2u, msg.inners()[2].GetCachedSize());
+
+  auto bytes = msg.SerializeAsString();
+  EXPECT_EQ(size, bytes.size());
+  WireMessage parsed;
+  ASSERT_TRUE(parsed.ParseFromString(bytes));
+  EXPECT_EQ(bytes, parsed.SerializeAsString());
+
+  // A copied message has to measure itself again.
+  WireMessage copied = msg;
+  EXPECT_EQ(0u, copied.GetCachedSize());
+  std::string buffer(size - 1, '\0');
+  EXPECT_FALSE(copied.SerializeToArray(buffer.data(), buffer.size()));
+  buffer.resize(size);
+  ASSERT_TRUE(copied.SerializeToArray(buffer.data(), buffer.size()));
+  EXPECT_EQ(bytes, buffer);
+}
+
+TEST(TestSerialize, Stream) {
+  char path[] = "/tmp/liteproto_stream_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  std::vector<WireView> views(100);
+  std::vector<std::string> names(100);
+  for (int i = 0; i < 100; i++) {
+    // The long names shrink and grow, so the scratch of the large records is reused with different sizes.
+    names[i] = i % 10 == 0 ? std::string(100 + i * 37 % 300, static_cast<char>('a' + i / 10)) : "v";
+    views[i].set_id(i);
+    views[i].set_name(names[i]);
+  }
+  {
+    // The buffer holds a few records, and a long name doesn't fit.
+    liteproto::MessageWriter writer(fd, 64);
+    for (const auto& view : views) {
+      ASSERT_TRUE(writer.Write(view));
+    }
+    ASSERT_TRUE(writer.Flush());
+    EXPECT_EQ(0u, writer.buffered());
+  }
+  close(fd);
+
+  liteproto::MessageReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  WireView view;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(reader.Next(&view));
+    EXPECT_EQ(static_cast<uint32_t>(i), view.id());
+    EXPECT_EQ(views[i].name(), view.name());
+  }
+  EXPECT_FALSE(reader.Next(&view));
+  EXPECT_FALSE(reader.malformed());
+  EXPECT_EQ(reader.size(), reader.offset());
+  reader.Close();
+  unlink(path);
+
+  // The records are the slices of the input, and a truncated record stops the reading.
+  const char raw[] = "\x02\x08\x01\x00\x05\x08";
+  liteproto::MessageReader memory(raw, sizeof(raw) - 1);
+  std::string_view record;
+  ASSERT_TRUE(memory.Next(&record));
+  EXPECT_EQ(raw + 1, record.data());
+  EXPECT_EQ(2u, record.size());
+  ASSERT_TRUE(memory.Next(&record));
+  EXPECT_TRUE(record.empty());
+  EXPECT_FALSE(memory.Next(&record));
+  EXPECT_TRUE(memory.malformed());
+}
+
+TEST(TestSerialize, Lazy) {
+  WireMessage msg;
+  msg.set_i32(7);
+  msg.mutable_inner().set_id(1);
+  msg.mutable_inner().set_name("inner");
+  msg.mutable_strs() = {"a", "b", "c"};
+  msg.mutable_dict()[3] = "three";
+  msg.mutable_inners().emplace_back().set_id(2);
+  auto bytes = msg.SerializeAsString();
+
+  // The lazy fields are forwarded as is, without being decoded.
+  WireMessage lazy;
+  ASSERT_TRUE(lazy.ParseLazyFromString(bytes));
+  EXPECT_EQ(bytes, lazy.SerializeAsString());
+  EXPECT_EQ(7, lazy.i32());
+  EXPECT_EQ("inner", lazy.inner().name());
+  EXPECT_EQ((std::vector<std::string>{"a", "b", "c"}), lazy.strs());
+  EXPECT_EQ("three", lazy.mutable_dict()[3]);
+  auto inners = liteproto::ObjectCast<std::vector<WireInner>>(lazy.Field(9));
+  ASSERT_NE(nullptr, inners);
+  EXPECT_EQ(2, inners->at(0).id());
+  EXPECT_EQ(bytes, lazy.SerializeAsString());
+
+  // The records are kept behind a single pointer, which a copy duplicates.
+  static_assert(sizeof(liteproto::internal::LazyFields) == sizeof(void*));
+  WireMessage source;
+  ASSERT_TRUE(source.ParseLazyFromString(bytes));
+  WireMessage copy = source;
+  EXPECT_EQ("inner", copy.inner().name());
+  copy = source;
+  EXPECT_EQ(bytes, copy.SerializeAsString());
+  EXPECT_EQ(bytes, source.SerializeAsString());
+
+  // A setter drops the records, and an eager merge appends to the decoded records.
+  ASSERT_TRUE(lazy.ParseLazyFromString(bytes));
+  lazy.set_strs({"x"});
+  ASSERT_TRUE(lazy.MergeFromArray(bytes.data(), bytes.size()));
+  EXPECT_EQ((std::vector<std::string>{"x", "a", "b", "c"}), lazy.strs());
+  EXPECT_EQ(2u, lazy.inners().size());
+  // The accesses which may decode a lazy field may also throw std::bad_alloc.
+  static_assert(!noexcept(lazy.DumpTuple()) && !noexcept(std::as_const(lazy).DumpTuple()));
+  static_assert(!noexcept(lazy.ByteSize(std::declval<const liteproto::FieldMask&>())));
+
+  // Only the framing is checked by a lazy parsing.
+  EXPECT_FALSE(lazy.ParseLazyFromString(std::string("\x3a\x05\x08", 3)));
+  std::string truncated("\x3a\x01\x08", 3);
+  ASSERT_TRUE(lazy.ParseLazyFromString(truncated));
+  EXPECT_EQ(0, lazy.inner().id());
+}
+
+TEST(TestSerialize, FieldMask) {
+  WireMessage msg;
+  msg.set_i32(7);
+  msg.set_str("str");
+  msg.mutable_inner().set_id(1);
+  msg.mutable_inner().set_name("inner");
+  msg.mutable_strs() = {"a", "b"};
+  auto bytes = msg.SerializeAsString();
+
+  auto mask = liteproto::FieldMask::FromPaths<WireMessage>({"i32", "inner.name", "8"});
+  ASSERT_TRUE(mask.has_value());
+  EXPECT_TRUE(mask->Test(0));
+  EXPECT_FALSE(mask->Test(5));
+  ASSERT_NE(nullptr, mask->Child(6));
+  EXPECT_TRUE(mask->Child(6)->Test(1));
+  EXPECT_FALSE(mask->Child(6)->Test(0));
+  EXPECT_EQ(nullptr, mask->Child(0));
+  auto copied = *mask;
+  ASSERT_NE(nullptr, copied.Child(6));
+  EXPECT_TRUE(copied.Child(6)->Test(1));
+
+  WireMessage parsed;
+  ASSERT_TRUE(parsed.ParseFromString(bytes, *mask));
+  EXPECT_EQ(7, parsed.i32());
+  EXPECT_EQ("", parsed.str());
+  EXPECT_EQ(0, parsed.inner().id());
+  EXPECT_EQ("inner", parsed.inner().name());
+  EXPECT_EQ(msg.strs(), parsed.strs());
+
+  // The encoding emits the same fields, and a whole message can be selected by its seq number.
+  EXPECT_EQ(parsed.SerializeAsString(), msg.SerializeAsString(*mask));
+  EXPECT_EQ(parsed.SerializeAsString().size(), msg.ByteSize(*mask));
+  auto seqs = liteproto::FieldMask::FromSeqs<WireMessage>({7});
+  ASSERT_TRUE(seqs.has_value());
+  EXPECT_EQ(std::string("\x3a\x09\x08\x01\x12\x05inner", 11), msg.SerializeAsString(*seqs));
+  EXPECT_TRUE(liteproto::FieldMask::FromPaths<WireMessage>({"inner.name", "inner"})->Child(6) == nullptr);
+
+  EXPECT_FALSE(liteproto::FieldMask::FromPaths<WireMessage>({"unknown"}).has_value());
+  EXPECT_FALSE(liteproto::FieldMask::FromPaths<WireMessage>({"str.size"}).has_value());
+  EXPECT_FALSE(liteproto::FieldMask::FromPaths<WireMessage>({"inner.unknown"}).has_value());
+  EXPECT_FALSE(liteproto::FieldMask::FromSeqs<WireMessage>({10}).has_value());
+
+  // An empty mask selects no field.
+  auto empty = liteproto::FieldMask::FromPaths<WireMessage>({});
+  ASSERT_TRUE(empty.has_value());
+  for (const auto& none : {*empty, liteproto::FieldMask{}}) {
+    EXPECT_FALSE(none.Test(0));
+    EXPECT_EQ("", msg.SerializeAsString(none));
+    EXPECT_EQ(0u, msg.ByteSize(none));
+    WireMessage skipped;
+    ASSERT_TRUE(skipped.ParseFromString(bytes, none));
+    EXPECT_EQ(0, skipped.i32());
+  }
+
+  // A mask only applies to the message type it's built for.
+  auto inner_mask = liteproto::FieldMask::FromPaths<WireInner>({"name"});
+  ASSERT_TRUE(inner_mask.has_value());
+  EXPECT_TRUE(inner_mask->IsFor<WireInner>());
+  EXPECT_FALSE(inner_mask->IsFor<WireMessage>());
+  EXPECT_TRUE(mask->Child(6)->IsFor<WireInner>());
+  std::string output;
+  EXPECT_FALSE(msg.SerializeToString(&output, *inner_mask));
+  EXPECT_EQ(0u, msg.ByteSize(*inner_mask));
+  WireMessage mismatched;
+  EXPECT_FALSE(mismatched.ParseFromString(bytes, *inner_mask));
+  EXPECT_EQ("inner", msg.inner().SerializeAsString(*inner_mask).substr(2));
+}
+
+TEST(TestMessage, FieldTable) {
+  // The accessors are shared by the type, so every instance reflects its own fields.
+  WireInner first, second;
+  first.set_id(1);
+  second.set_id(2);
+  for (auto msg : {&first, &second}) {
+    auto number = liteproto::NumberCast(msg->Field(0));
+    ASSERT_TRUE(number.has_value());
+    EXPECT_EQ(msg->id(), number->AsInt64());
+    number->SetInt64(msg->id() * 10);
+    const liteproto::Message& const_msg = *msg;
+    auto name = liteproto::StringCast<liteproto::ConstOption::CONST>(const_msg.Field(1));
+    ASSERT_TRUE(name.has_value());
+    EXPECT_EQ(msg->Field(1).Addr(), const_msg.Field(1).Addr());
+  }
+  EXPECT_EQ(10, first.id());
+  EXPECT_EQ(20, second.id());
+  EXPECT_TRUE(first.Field(2).empty());
+}
+
+TEST(TestMessage, FieldByName) {
+  WireMessage msg;
+  msg.set_str("str");
+  const liteproto::Message& base = msg;
+  std::string_view name = "str";
+  EXPECT_TRUE(base.HasName(name));
+  EXPECT_TRUE(base.HasName("inners"));
+  EXPECT_FALSE(base.HasName("st"));
+  EXPECT_FALSE(base.HasName(""));
+  EXPECT_EQ(msg.Field(5).Addr(), base.Field(name).Addr());
+  EXPECT_EQ("str", liteproto::StringCast<liteproto::ConstOption::CONST>(base.Field("str"))->str());
+  EXPECT_TRUE(base.Field("unknown").empty());
+  EXPECT_EQ("inners", base.FieldName(9));
+  EXPECT_EQ("", base.FieldName(10));
+}
+
+TEST(TestReflection, TrivialObject) {
+  static_assert(std::is_trivially_copyable_v<liteproto::Object>);
+  static_assert(sizeof(liteproto::Object) == 3 * sizeof(void*));
+  std::vector<int> list{1, 2};
+  const std::string str = "str";
+  auto list_obj = liteproto::GetReflection(&list);
+  auto str_obj = liteproto::GetReflection(&str);
+
+  EXPECT_EQ(&list, liteproto::ObjectCast<std::vector<int>>(list_obj));
+  EXPECT_EQ(nullptr, liteproto::ObjectCast<const std::vector<int>>(list_obj));
+  EXPECT_EQ(nullptr, liteproto::ObjectCast<std::string>(str_obj));
+  EXPECT_EQ(&str, liteproto::ObjectCast<const std::string>(str_obj));
+
+  auto copied = list_obj;
+  auto numbers = liteproto::ListCast<liteproto::Number>(copied);
+  ASSERT_TRUE(numbers.has_value());
+  numbers->push_back(3);
+  EXPECT_EQ(3u, list.size());
+  EXPECT_FALSE(liteproto::ListCast<liteproto::Object>(copied).has_value());
+  EXPECT_FALSE(liteproto::StringCast(copied).has_value());
+  EXPECT_FALSE(liteproto::StringCast(str_obj).has_value());
+  EXPECT_EQ("str", liteproto::StringCast<liteproto::ConstOption::CONST>(str_obj)->str());
+  EXPECT_FALSE(liteproto::NumberCast(liteproto::Object{}).has_value());
+}
+
+TEST(TestReflection, ConstexprDescriptor) {
+  using Map = std::map<int32_t, std::string>;
+  constexpr const liteproto::TypeDescriptor& descriptor = liteproto::TypeMeta<Map>::GetDescriptor();
+  static_assert(descriptor.TypeEnum() == liteproto::Type::STD_MAP);
+  static_assert(descriptor.SizeOf() == sizeof(Map));
+  static_assert(descriptor.AlignmentOf() == alignof(Map));
+  static_assert(descriptor.ValueType().TypeEnum() == liteproto::Type::STD_PAIR);
+  static_assert(descriptor.ValueType().FirstType().TypeEnum() == liteproto::Type::INT32);
+  static_assert(descriptor.ValueType().SecondType().TypeEnum() == liteproto::Type::STD_STRING);
+  static_assert(liteproto::TypeMeta<const int32_t>::GetDescriptor().Traits(liteproto::traits::is_const));
+  static_assert(liteproto::TypeMeta<int32_t>::GetDescriptor().Traits(liteproto::traits::is_signed));
+  static_assert(!liteproto::TypeMeta<uint32_t>::GetDescriptor().Traits(liteproto::traits::is_signed));
+  static_assert(&liteproto::TypeMeta<int32_t*>::GetDescriptor().ValueType() == &liteproto::TypeMeta<int32_t>::GetDescriptor());
+
+  EXPECT_EQ(liteproto::TypeMeta<int32_t>::GetDescriptor(), liteproto::TypeMeta<int32_t*>::GetDescriptor().ValueType());
+  EXPECT_NE(liteproto::TypeMeta<int32_t>::GetDescriptor(), liteproto::TypeMeta<uint32_t>::GetDescriptor());
+  EXPECT_EQ(liteproto::TypeMeta<int32_t>::Id(), liteproto::TypeMeta<int32_t>::GetDescriptor().Id());
+  EXPECT_EQ(liteproto::Type::INT32,
+            liteproto::TypeMeta<const int32_t>::GetDescriptor().Transform(liteproto::transform::remove_const).TypeEnum());
+  EXPECT_TRUE(liteproto::Number(int8_t{-1}).IsSignedInteger());
+  EXPECT_TRUE(liteproto::Number(uint16_t{1}).IsUnsigned());
+}
+
+TEST(TestReflection, NumberTag) {
+  int16_t i16 = -3;
+  uint8_t u8 = 200;
+  bool flag = false;
+  float f32 = 1.5;
+  liteproto::Number number = int64_t{-7};
+
+  liteproto::NumberReference i16_ref(i16);
+  liteproto::NumberReference u8_ref(u8);
+  liteproto::NumberReference flag_ref(flag);
+  liteproto::NumberReference f32_ref(f32);
+  liteproto::NumberReference number_ref(number);
+
+  EXPECT_TRUE(i16_ref.IsSignedInteger());
+  EXPECT_EQ(-3, i16_ref.AsInt64());
+  i16_ref.SetInt64(-300);
+  EXPECT_EQ(-300, i16);
+  EXPECT_TRUE(u8_ref.IsUnsigned() && !u8_ref.IsSignedInteger());
+  EXPECT_EQ(200u, u8_ref.AsUInt64());
+  EXPECT_TRUE(flag_ref.IsUnsigned());
+  flag_ref.SetUInt64(2);
+  EXPECT_TRUE(flag);
+  EXPECT_TRUE(f32_ref.IsFloating());
+  EXPECT_EQ(1.5, f32_ref.AsFloat64());
+  f32_ref.SetInt64(3);
+  EXPECT_EQ(3.0f, f32);
+
+  EXPECT_TRUE(number_ref.IsSignedInteger());
+  EXPECT_EQ(-7, number_ref.AsInt64());
+  number_ref.SetFloat64(2.5);
+  EXPECT_TRUE(number.IsFloating());
+  EXPECT_TRUE(number_ref.IsFloating());
+  EXPECT_EQ(liteproto::Type::FLOAT64, number_ref.Descriptor().TypeEnum());
+  EXPECT_EQ(2.5, liteproto::Number(number_ref).AsFloat64());
+
+  liteproto::NumberReference<liteproto::ConstOption::CONST> const_ref = i16_ref;
+  EXPECT_EQ(-300, const_ref.AsInt64());
+  liteproto::Number copied = const_ref;
+  EXPECT_TRUE(copied.IsSignedInteger());
+  EXPECT_EQ(sizeof(int16_t), copied.Descriptor().SizeOf());
+  EXPECT_EQ(-300, copied.AsInt64());
+}
+
+TEST(TestList, RandomAccessIterator) {
+  std::vector<int32_t> vec{0, 1, 2, 3, 4, 5};
+  std::deque<int32_t> deq{0, 1, 2, 3, 4, 5};
+  std::list<int32_t> lst{0, 1, 2, 3, 4, 5};
+  auto vec_list = liteproto::AsList(&vec);
+  auto deq_list = liteproto::AsList(&deq);
+  auto lst_list = liteproto::AsList(&lst);
+  // A List may wrap any container, so its iterator is bidirectional, and the random access one is optional.
+  using iterator = decltype(vec_list.begin());
+  static_assert(std::is_same_v<std::iterator_traits<iterator>::iterator_category, std::bidirectional_iterator_tag>);
+  static_assert(std::is_same_v<iterator, decltype(lst_list.begin())>);
+  using random_access_iterator = decltype(vec_list)::random_access_iterator;
+  static_assert(std::is_same_v<std::iterator_traits<random_access_iterator>::iterator_category, std::random_access_iterator_tag>);
+  EXPECT_FALSE(lst_list.random_access().has_value());
+  EXPECT_EQ(2, std::distance(lst_list.begin(), std::next(lst_list.begin(), 2)));
+
+  for (auto list : {vec_list, deq_list}) {
+    auto range = list.random_access();
+    ASSERT_TRUE(range.has_value());
+    auto [begin, end] = *range;
+    EXPECT_EQ(6, end - begin);
+    EXPECT_EQ(-6, begin - end);
+    EXPECT_TRUE(begin < end && end > begin && begin <= begin && !(begin < begin));
+    auto it = begin + 4;
+    EXPECT_EQ(4, (*it).AsInt64());
+    it -= 3;
+    EXPECT_EQ(1, (*it).AsInt64());
+    EXPECT_EQ(5, it[4].AsInt64());
+    EXPECT_EQ(3, (end - 3)[0].AsInt64());
+    EXPECT_TRUE(2 + begin == std::next(begin, 2));
+    EXPECT_EQ(2, std::distance(begin, begin + 2));
+    it[0].SetInt64(10);
+    (--end)[0].SetInt64(50);
+  }
+  EXPECT_EQ(10, vec[1]);
+  EXPECT_EQ(50, vec[5]);
+  EXPECT_EQ(10, deq[1]);
+  EXPECT_EQ(50, deq.back());
+
+  auto copied = vec_list.begin();
+  copied = lst_list.begin();
+  EXPECT_TRUE(copied == lst_list.begin());
+  EXPECT_TRUE(copied != vec_list.begin());
+}
+
+TEST(TestList, Contiguous) {
+  std::vector<int32_t> vec{1, 2, 3};
+  std::list<int32_t> lst{1, 2, 3};
+  std::string str = "abc";
+  auto list = liteproto::AsList(&vec);
+  auto const_list = liteproto::AsList(static_cast<const std::vector<int32_t>*>(&vec));
+
+  auto span = list.contiguous();
+  ASSERT_TRUE(span.has_value());
+  EXPECT_EQ(vec.data(), span->data());
+  EXPECT_EQ(3u, span->size());
+  EXPECT_EQ(liteproto::Type::INT32, span->Descriptor().TypeEnum());
+  EXPECT_EQ(vec.data(), span->As<int32_t>());
+  EXPECT_EQ(nullptr, span->As<uint32_t>());
+  EXPECT_FALSE(liteproto::AsList(&lst).contiguous().has_value());
+  EXPECT_EQ(str.data(), liteproto::AsString(&str).contiguous()->data());
+
+  int32_t out[4] = {};
+  EXPECT_TRUE(const_list.CopyTo(out, 4));
+  EXPECT_EQ(3, out[2]);
+  EXPECT_FALSE(list.CopyTo(out, 2));
+  uint32_t wrong[4] = {};
+  EXPECT_FALSE(list.CopyTo(wrong, 4));
+  EXPECT_FALSE(liteproto::AsList(&lst).CopyTo(out, 4));
+
+  const int32_t in[] = {7, 8, 9, 10};
+  EXPECT_TRUE(list.AssignFrom(in, 4));
+  EXPECT_EQ((std::vector<int32_t>{7, 8, 9, 10}), vec);
+  EXPECT_TRUE(liteproto::AsList(&lst).AssignFrom(in, 2));
+  EXPECT_EQ((std::list<int32_t>{7, 8}), lst);
+  EXPECT_FALSE(list.AssignFrom(wrong, 4));
+  EXPECT_TRUE(liteproto::AsString(&str).AssignFrom("xy", 2));
+  EXPECT_EQ("xy", str);
+}
+
+TEST(TestList, CapacityAndRange) {
+  std::vector<int32_t> vec{1, 2};
+  auto list = liteproto::AsList(&vec);
+  list.reserve(64);
+  EXPECT_GE(vec.capacity(), 64u);
+  EXPECT_EQ(vec.capacity(), list.capacity());
+  liteproto::Number numbers[] = {3, 4, 5};
+  list.append(numbers, 3);
+  EXPECT_EQ((std::vector<int32_t>{1, 2, 3, 4, 5}), vec);
+  auto it = list.insert(std::next(list.begin(), 1), numbers, 2);
+  EXPECT_EQ(3, (*it).AsInt64());
+  EXPECT_EQ((std::vector<int32_t>{1, 3, 4, 2, 3, 4, 5}), vec);
+  list.shrink_to_fit();
+  EXPECT_EQ(vec.size(), vec.capacity());
+  const auto& const_vec = vec;
+  EXPECT_EQ(vec.capacity(), liteproto::AsList(&const_vec).capacity());
+
+  std::list<int32_t> lst;
+  auto lst_list = liteproto::AsList(&lst);
+  lst_list.reserve(8);
+  lst_list.append(numbers, 3);
+  EXPECT_EQ(3u, lst_list.capacity());
+
+  std::vector<std::string> strs{"a"};
+  std::string b = "b", c = "c";
+  liteproto::Object objects[] = {liteproto::GetReflection(&b), liteproto::GetReflection(&c)};
+  liteproto::AsList(&strs).append(objects, 2);
+  EXPECT_EQ((std::vector<std::string>{"a", "b", "c"}), strs);
+
+  std::string str = "ab";
+  auto string = liteproto::AsString(&str);
+  string.reserve(100);
+  EXPECT_GE(string.capacity(), 100u);
+  const char tail[] = {'c', 'd'};
+  string.insert(string.end(), tail, 2);
+  EXPECT_EQ("abcd", str);
+
+  std::unordered_map<int32_t, double> map;
+  auto map_interface = liteproto::AsMap(&map);
+  map_interface.reserve(100);
+  EXPECT_GE(map.bucket_count(), 100u);
+  map_interface.rehash(200);
+  EXPECT_GE(map.bucket_count(), 200u);
+  std::pair<liteproto::Number, liteproto::Number> pairs[] = {{1, 1.5}, {2, 2.5}};
+  map_interface.insert(pairs, 2);
+  EXPECT_EQ(2u, map.size());
+  EXPECT_EQ(2.5, map[2]);
+  std::map<int32_t, double> ordered;
+  liteproto::AsMap(&ordered).reserve(10);
+  liteproto::AsMap(&ordered).insert(pairs, 2);
+  EXPECT_EQ(1.5, ordered[1]);
+}
+
+TEST(TestList, IndexedAccess) {
+  std::list<int32_t> values;
+  for (int32_t i = 0; i < 100; ++i) {
+    values.push_back(i);
+  }
+  auto list = liteproto::AsList(&values);
+  auto cursor = list.cursor();
+  ASSERT_EQ(100u, cursor.size());
+  for (size_t i = 0; i < cursor.size(); ++i) {
+    EXPECT_EQ(static_cast<int32_t>(i), cursor[i].AsInt64());
+  }
+  for (size_t i = cursor.size(); i > 0; --i) {
+    EXPECT_EQ(static_cast<int32_t>(i - 1), cursor[i - 1].AsInt64());
+  }
+  EXPECT_EQ(50, cursor[50].AsInt64());
+  EXPECT_EQ(3, cursor[3].AsInt64());
+  EXPECT_EQ(97, cursor[97].AsInt64());
+  cursor[97].SetInt64(-97);
+  EXPECT_EQ(-97, *std::next(values.begin(), 97));
+
+  // The List itself keeps no position, so the mutations behind it never leave a dangling one.
+  EXPECT_EQ(50, list[50].AsInt64());
+  values.erase(std::next(values.begin(), 50));
+  values.push_back(100);
+  EXPECT_EQ(52, list[51].AsInt64());
+  auto copy = list;
+  copy.erase(std::next(copy.begin(), 10));
+  copy.push_back(liteproto::Number{101});
+  EXPECT_EQ(12, list[11].AsInt64());
+
+  std::deque<int32_t> deque{1, 2, 3};
+  auto deque_cursor = liteproto::AsList(static_cast<const std::deque<int32_t>*>(&deque)).cursor();
+  EXPECT_EQ(3, deque_cursor[2].AsInt64());
+  EXPECT_EQ(1, deque_cursor[0].AsInt64());
+}
+
+TEST(TestMessage, ForEachField) {
+  TestMessage<int, float, std::string> my_msg{1, 2.5, "str"};
+  std::vector<std::string_view> names;
+  std::vector<int32_t> seqs;
+  liteproto::ForEachField(my_msg, [&](std::string_view name, int32_t seq, auto& value) {
+    names.push_back(name);
+    seqs.push_back(seq);
+    if constexpr (std::is_same_v<std::string, std::decay_t<decltype(value)>>) {
+      value.append("str");
+    } else {
+      value++;
+    }
+  });
+  EXPECT_EQ((std::vector<std::string_view>{"foo", "bar", "baz"}), names);
+  EXPECT_EQ((std::vector<int32_t>{1, 2, 3}), seqs);
+  EXPECT_EQ(2, my_msg.foo());
+  EXPECT_DOUBLE_EQ(3.5, my_msg.bar());
+  EXPECT_EQ("strstr", my_msg.baz());
+
+  const auto& const_msg = my_msg;
+  size_t total = 0;
+  liteproto::ForEachField(const_msg, [&](std::string_view, int32_t, const auto& value) {
+    static_assert(std::is_const_v<std::remove_reference_t<decltype(value)>>);
+    if constexpr (std::is_same_v<std::string, std::decay_t<decltype(value)>>) {
+      total += value.size();
+    }
+  });
+  EXPECT_EQ(6u, total);
+
+  std::string visited;
+  auto fn = [&](const auto& value) {
+    if constexpr (std::is_same_v<std::string, std::decay_t<decltype(value)>>) {
+      visited = value;
+    }
+  };
+  const_msg.Visit(2, fn);
+  EXPECT_EQ("strstr", visited);
+  visited.clear();
+  const_msg.Visit(3, fn);
+  EXPECT_TRUE(visited.empty());
+}
+
+TEST(TestReflection, NestedMessage) {
+  WireMessage msg;
+  msg.mutable_inner().set_id(7);
+  msg.mutable_inners().emplace_back().set_name("first");
+  msg.mutable_dict()[1] = "x";
+
+  auto inner = msg.Field("inner");
+  EXPECT_EQ(liteproto::Kind::MESSAGE, inner.Descriptor().KindEnum());
+  liteproto::Message* inner_msg = liteproto::MessageCast(inner);
+  ASSERT_NE(nullptr, inner_msg);
+  EXPECT_EQ(2u, inner_msg->FieldsSize());
+  auto id = liteproto::NumberCast(inner_msg->Field("id"));
+  ASSERT_TRUE(id.has_value());
+  EXPECT_EQ(7, id->AsInt64());
+  id->SetInt64(8);
+  EXPECT_EQ(8, msg.inner().id());
+
+  // Messages inside a list are reflected through the elements.
+  auto inners = liteproto::ListCast<liteproto::Object>(msg.Field("inners"));
+  ASSERT_TRUE(inners.has_value());
+  EXPECT_EQ(liteproto::Kind::MESSAGE, (*inners)[0].Descriptor().KindEnum());
+  auto element = liteproto::MessageCast((*inners)[0]);
+  ASSERT_NE(nullptr, element);
+  auto name = liteproto::StringCast(element->Field("name"));
+  ASSERT_TRUE(name.has_value());
+  EXPECT_EQ("first", name->str());
+
+  // And so are the maps, both as a field and with messages as values.
+  auto dict = msg.Field("dict");
+  EXPECT_EQ(liteproto::Kind::MAP, dict.Descriptor().KindEnum());
+  auto dict_map = liteproto::MapCast<liteproto::Number, liteproto::Object>(dict);
+  ASSERT_TRUE(dict_map.has_value());
+  EXPECT_EQ(1u, dict_map->size());
+  std::map<int, WireInner> messages;
+  messages[3].set_id(30);
+  for (auto [key, value] : liteproto::AsMap(&messages)) {
+    EXPECT_EQ(3, key.AsInt64());
+    auto value_msg = liteproto::MessageCast<liteproto::ConstOption::CONST>(value);
+    ASSERT_NE(nullptr, value_msg);
+    auto value_id = liteproto::NumberCast<liteproto::ConstOption::CONST>(value_msg->Field("id"));
+    ASSERT_TRUE(value_id.has_value());
+    EXPECT_EQ(30, value_id->AsInt64());
+  }
+
+  // A const message can only be cast as const.
+  const auto& const_msg = msg;
+  auto const_inner = const_msg.Field("inner");
+  EXPECT_EQ(nullptr, liteproto::MessageCast(const_inner));
+  ASSERT_NE(nullptr, liteproto::MessageCast<liteproto::ConstOption::CONST>(const_inner));
+  EXPECT_EQ(nullptr, liteproto::MessageCast(msg.Field("i32")));
+}
+
+// The arena is opt-in, liteproto.hpp only includes it if the standard library has <memory_resource> (GCC 9+).
+#if __has_include(<memory_resource>)
+MESSAGE(ArenaInner) {
+  std::pmr::string FIELD(name)->Seq<1>;
+  std::pmr::vector<int32_t> FIELD(ids)->Seq<2>;
+};
+
+MESSAGE(ArenaMessage) {
+  std::pmr::string FIELD(title)->Seq<1>;
+  ArenaInner FIELD(inner)->Seq<2>;
+  std::pmr::vector<ArenaInner> FIELD(items)->Seq<3>;
+  std::pmr::map<std::pmr::string, ArenaInner> FIELD(dict)->Seq<4>;
+  std::pmr::deque<std::pmr::string> FIELD(names)->Seq<5>;
+  std::string FIELD(heap)->Seq<6>;
+};
+
+TEST(TestArena, Basic) {
+  static_assert(liteproto::IsStringV<std::pmr::string>);
+  static_assert(liteproto::IsListV<std::pmr::vector<ArenaInner>> && liteproto::IsListV<std::pmr::deque<std::pmr::string>>);
+  static_assert(liteproto::IsMapV<std::pmr::map<std::pmr::string, ArenaInner>>);
+
+  ArenaMessage source;
+  source.set_title(std::pmr::string(100, 't'));
+  source.mutable_inner().set_name(std::pmr::string(50, 'i'));
+  source.mutable_inner().mutable_ids() = {1, 2, 3};
+  for (int i = 0; i < 3; ++i) {
+    auto& item = source.mutable_items().emplace_back();
+    item.set_name(std::pmr::string(40, static_cast<char>('a' + i)));
+    item.mutable_ids().push_back(i);
+    source.mutable_dict()[std::pmr::string(30, static_cast<char>('k' + i))].set_name(std::pmr::string(30, 'v'));
+    source.mutable_names().emplace_back(60, static_cast<char>('n' + i));
+  }
+  source.set_heap("heap");
+  std::string bytes = source.SerializeAsString();
+  std::string json;
+  ASSERT_TRUE(liteproto::ToJsonString(source, &json));
+
+  liteproto::Arena arena;
+  auto resource = arena.resource();
+  auto on_arena = [resource](const ArenaMessage& msg) {
+    EXPECT_EQ(resource, msg.title().get_allocator().resource());
+    EXPECT_EQ(resource, msg.inner().name().get_allocator().resource());
+    EXPECT_EQ(resource, msg.inner().ids().get_allocator().resource());
+    EXPECT_EQ(resource, msg.items().get_allocator().resource());
+    for (const auto& item : msg.items()) {
+      EXPECT_EQ(resource, item.name().get_allocator().resource());
+      EXPECT_EQ(resource, item.ids().get_allocator().resource());
+    }
+    for (const auto& [key, value] : msg.dict()) {
+      EXPECT_EQ(resource, key.get_allocator().resource());
+      EXPECT_EQ(resource, value.name().get_allocator().resource());
+    }
+    for (const auto& name : msg.names()) {
+      EXPECT_EQ(resource, name.get_allocator().resource());
+    }
+  };
+
+  // Nothing is allocated outside of the arena while decoding, except the std::string field.
+  auto msg = arena.Create<ArenaMessage>();
+  auto json_msg = arena.Create<ArenaMessage>();
+  auto previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+  bool parsed = msg->ParseFromString(bytes);
+  bool json_parsed = liteproto::FromJson(json, json_msg);
+  std::pmr::set_default_resource(previous);
+  ASSERT_TRUE(parsed);
+  ASSERT_TRUE(json_parsed);
+  for (auto parsed_msg : {msg, json_msg}) {
+    on_arena(*parsed_msg);
+    EXPECT_EQ(source.title(), parsed_msg->title());
+    EXPECT_EQ(source.inner().ids(), parsed_msg->inner().ids());
+    ASSERT_EQ(3u, parsed_msg->items().size());
+    EXPECT_EQ(source.items()[2].name(), parsed_msg->items()[2].name());
+    EXPECT_EQ(source.dict().size(), parsed_msg->dict().size());
+    EXPECT_EQ(source.names(), parsed_msg->names());
+    EXPECT_EQ("heap", parsed_msg->heap());
+  }
+
+  // A value which is not on the arena is moved onto it.
+  auto copied = arena.Create<ArenaMessage>(source);
+  on_arena(*copied);
+  EXPECT_EQ(copied->SerializeAsString(), bytes);
+  auto list = arena.Create<std::pmr::vector<ArenaInner>>(source.items());
+  EXPECT_EQ(resource, (*list)[0].name().get_allocator().resource());
+
+  arena.Reset();
+  auto reused = arena.Create<ArenaMessage>();
+  EXPECT_EQ(arena.resource(), reused->title().get_allocator().resource());
+}
+#endif  // __has_include(<memory_resource>)
+
+TEST(TestMessage, ClearAndPool) {
+  WireMessage source;
+  source.set_i32(150);
+  source.set_str(std::string(100, 's'));
+  source.mutable_strs() = {std::string(50, 'a'), "b"};
+  source.mutable_inner().set_name(std::string(60, 'n'));
+  source.mutable_dict()[1] = "x";
+  std::string bytes = source.SerializeAsString();
+
+  WireMessage msg;
+  ASSERT_TRUE(msg.ParseFromString(bytes));
+  size_t str_capacity = msg.str().capacity();
+  size_t strs_capacity = msg.strs().capacity();
+  size_t inner_capacity = msg.inner().name().capacity();
+  msg.Clear();
+  EXPECT_EQ(0, msg.i32());
+  EXPECT_TRUE(msg.str().empty() && msg.strs().empty() && msg.dict().empty() && msg.inner().name().empty());
+  EXPECT_EQ(str_capacity, msg.str().capacity());
+  EXPECT_EQ(strs_capacity, msg.strs().capacity());
+  EXPECT_EQ(inner_capacity, msg.inner().name().capacity());
+  EXPECT_EQ(std::string("\x3a\x00", 2), msg.SerializeAsString());
+
+  using Pool = liteproto::MessagePool<WireMessage>;
+  Pool::SetMaxSize(2);
+  WireMessage* first;
+  {
+    auto pooled = Pool::Acquire();
+    first = pooled.get();
+    ASSERT_TRUE(pooled->ParseFromString(bytes));
+  }
+  EXPECT_EQ(1u, Pool::Size());
+  {
+    auto pooled = Pool::Acquire();
+    EXPECT_EQ(first, pooled.get());
+    EXPECT_EQ(0u, Pool::Size());
+    EXPECT_TRUE(pooled->str().empty());
+    EXPECT_GE(pooled->str().capacity(), 100u);
+    auto other = Pool::Acquire();
+    auto third = Pool::Acquire();
+    EXPECT_NE(first, other.get());
+  }
+  EXPECT_EQ(2u, Pool::Size());
+  Pool::SetMaxSize(0);
+  EXPECT_EQ(0u, Pool::Size());
+  Pool::SetMaxSize(Pool::kDefaultMaxSize);
+  Pool::Reserve(3);
+  EXPECT_EQ(3u, Pool::Size());
+
+  // Release() doesn't allocate, so a message is deleted if the free list of this thread has no capacity yet.
+  using InnerPool = liteproto::MessagePool<WireInner>;
+  InnerPool::Release(new WireInner());
+  EXPECT_EQ(0u, InnerPool::Size());
+  {
+    auto pooled = InnerPool::Acquire();
+    EXPECT_EQ(0u, InnerPool::Size());
+  }
+  EXPECT_EQ(1u, InnerPool::Size());
+}
+
+TEST(TestMessage, EqualsAndHash) {
+  WireMessage lhs;
+  lhs.set_i32(1);
+  lhs.set_i64(-2);
+  lhs.set_flag(true);
+  lhs.set_f64(0.5);
+  lhs.set_str("str");
+  lhs.mutable_inner().set_name("inner");
+  lhs.mutable_strs() = {"a", "b"};
+  lhs.mutable_dict() = {{1, "x"}, {2, "y"}};
+  lhs.mutable_inners().emplace_back().set_id(3);
+  WireMessage rhs = lhs;
+  EXPECT_TRUE(liteproto::Equals(lhs, rhs));
+  EXPECT_EQ(liteproto::Hash(lhs), liteproto::Hash(rhs));
+
+  // A copy parsed from the wire format has the same content.
+  std::string bytes = lhs.SerializeAsString();
+  WireMessage parsed;
+  ASSERT_TRUE(parsed.ParseLazyFromString(bytes));
+  EXPECT_TRUE(liteproto::Equals(lhs, parsed));
+  EXPECT_EQ(liteproto::Hash(lhs), liteproto::Hash(parsed));
+
+  std::vector<std::function<void(WireMessage&)>> mutations{
+      [](WireMessage& m) { m.set_i32(2); },
+      [](WireMessage& m) { m.set_i64(-3); },
+      [](WireMessage& m) { m.set_flag(false); },
+      [](WireMessage& m) { m.set_f64(0.25); },
+      [](WireMessage& m) { m.set_f32(1.0f); },
+      [](WireMessage& m) { m.mutable_str().push_back('s'); },
+      [](WireMessage& m) { m.mutable_inner().set_id(4); },
+      [](WireMessage& m) { m.mutable_strs().back() = "c"; },
+      [](WireMessage& m) { m.mutable_dict()[2] = "z"; },
+      [](WireMessage& m) { m.mutable_inners().emplace_back(); },
+  };
+  for (const auto& mutate : mutations) {
+    WireMessage changed = lhs;
+    mutate(changed);
+    EXPECT_FALSE(liteproto::Equals(lhs, changed));
+    EXPECT_NE(liteproto::Hash(lhs), liteproto::Hash(changed));
+  }
+
+  std::unordered_map<WireMessage, int, liteproto::MessageHasher, liteproto::MessageEqual> dedupe;
+  for (const auto& msg : {lhs, rhs, parsed}) {
+    ++dedupe[msg];
+  }
+  ASSERT_EQ(1u, dedupe.size());
+  EXPECT_EQ(3, dedupe.begin()->second);
+
+  // The entries of an unordered map are compared regardless of the order.
+  std::unordered_map<int32_t, std::string> entries_a, entries_b;
+  for (int32_t i = 0; i < 64; ++i) {
+    entries_a[i] = std::to_string(i);
+    entries_b[63 - i] = std::to_string(63 - i);
+  }
+  EXPECT_TRUE(liteproto::internal::ValueEquals(entries_a, entries_b));
+  EXPECT_EQ(liteproto::internal::ValueHash(entries_a), liteproto::internal::ValueHash(entries_b));
+
+  // The values of a key in a multimap are compared as a multiset.
+  std::unordered_multimap<int32_t, int32_t> multi_a{{1, 1}, {1, 2}, {2, 3}}, multi_b{{2, 3}, {1, 2}, {1, 1}};
+  EXPECT_TRUE(liteproto::internal::ValueEquals(multi_a, multi_b));
+  EXPECT_EQ(liteproto::internal::ValueHash(multi_a), liteproto::internal::ValueHash(multi_b));
+  std::unordered_multimap<int32_t, int32_t> multi_c{{1, 1}, {1, 1}, {2, 3}};
+  EXPECT_FALSE(liteproto::internal::ValueEquals(multi_a, multi_c));
+  EXPECT_FALSE(liteproto::internal::ValueEquals(multi_c, multi_a));
+  std::multimap<int32_t, int32_t> ordered_a{{1, 1}, {1, 2}}, ordered_b{{1, 2}, {1, 1}}, ordered_c{{1, 1}, {2, 2}};
+  EXPECT_TRUE(liteproto::internal::ValueEquals(ordered_a, ordered_b));
+  EXPECT_FALSE(liteproto::internal::ValueEquals(ordered_a, ordered_c));
+  static_assert(liteproto::internal::HasUniqueKeys<std::map<int32_t, int32_t>>());
+  static_assert(!liteproto::internal::HasUniqueKeys<std::multimap<int32_t, int32_t>>());
+}
+
+TEST(TestMessage, DiffAndPatch) {
+  WireMessage old_msg;
+  old_msg.set_i32(1);
+  old_msg.set_i64(-2);
+  old_msg.set_str(std::string(256, 's'));
+  old_msg.mutable_inner().set_name("inner");
+  for (int32_t i = 0; i < 64; ++i) {
+    old_msg.mutable_strs().push_back(std::to_string(i));
+    old_msg.mutable_dict()[i] = std::to_string(i);
+    auto& inner = old_msg.mutable_inners().emplace_back();
+    inner.set_id(i);
+    inner.set_name(std::to_string(i));
+  }
+  EXPECT_TRUE(liteproto::Diff(old_msg, old_msg).empty());
+
+  WireMessage new_msg = old_msg;
+  new_msg.set_i32(0);
+  new_msg.set_flag(true);
+  new_msg.mutable_inner().set_id(7);
+  new_msg.mutable_strs()[3] = "three";
+  new_msg.mutable_inners()[5].set_name("");
+  new_msg.mutable_inners().emplace_back().set_id(64);
+  std::string delta = liteproto::Diff(old_msg, new_msg);
+  EXPECT_LT(delta.size() * 10, new_msg.SerializeAsString().size());
+
+  WireMessage patched = old_msg;
+  ASSERT_TRUE(liteproto::ApplyPatch(&patched, delta));
+  EXPECT_TRUE(liteproto::Equals(new_msg, patched));
+
+  // A patch onto a lazily parsed message, and a list that shrinks.
+  std::string bytes = old_msg.SerializeAsString();
+  WireMessage parsed;
+  ASSERT_TRUE(parsed.ParseLazyFromString(bytes));
+  new_msg.mutable_inners().resize(2);
+  new_msg.mutable_dict().erase(0);
+  delta = liteproto::Diff(old_msg, new_msg);
+  ASSERT_TRUE(liteproto::ApplyPatch(&parsed, delta));
+  EXPECT_TRUE(liteproto::Equals(new_msg, parsed));
+
+  // A truncated delta is rejected.
+  EXPECT_FALSE(liteproto::ApplyPatch(&patched, std::string_view(delta).substr(0, delta.size() - 1)));
+}